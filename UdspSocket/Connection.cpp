@@ -53,9 +53,11 @@ void UDSPSocket::Connection::partialReset() {
     PMTUProbeResponse_B = 0;
 
     rxPacketsLossInWindow_prc100 = 0;
+    rxPacketsLossSent_prc100 = 0;
 
     RTTRequest = 0;
     RTTResponse = 0;
+    RTTResponseSent = 0;
     RTT_us = 1000;
     nextMinRTT_us = UINT32_MAX;
     minRTT_us = UINT32_MAX;
@@ -65,7 +67,12 @@ void UDSPSocket::Connection::partialReset() {
 
     next1Hz_us = 0;
 
+    ackEveryN = 1;
+    maxAckDelay_us = 0;
+    isAckFrequencyChanged = peerAckEveryN != 1 or peerMaxAckDelay_us != 0;
+
     prevTick_us = 0;
+    nextDeparture_us = 0;
     txLimit_B_s = g_txLimitDefault_B_s;
 }
 
@@ -109,19 +116,24 @@ bool UDSPSocket::Connection::writePacket(
 
     nextDatagram();
 
+    // Not yet due acks don't make an ack-only datagram, but fill a data one
+    const bool isAckDue = forceSend or isTestBandwidthEnabled
+        or rxStreams.isAckDue(ackEveryN, maxAckDelay_us, now_us);
     size_t offset_B = sizeof(PacketHeader);
     while (true) {
         const uint32_t available_B = uint32_t(txBuffer.size() - offset_B);
         if (available_B == 0) {
             break;
         }
-        const uint32_t written_B = writeMetaChunk(now_us, &txBuffer[offset_B], available_B);
+        const uint32_t written_B = writeMetaChunk(
+            now_us, &txBuffer[offset_B], available_B, isAckDue);
         assert(written_B <= available_B);
         if (written_B <= 0) {
             break;
         }
         offset_B += written_B;
     }
+    const size_t metaOffset_B = offset_B;
     while (true) {
         const uint32_t available_B = uint32_t(txBuffer.size() - offset_B);
         if (available_B == 0) {
@@ -134,6 +146,18 @@ bool UDSPSocket::Connection::writePacket(
         }
         offset_B += written_B;
     }
+    while (not isAckDue and offset_B != metaOffset_B) {
+        const uint32_t available_B = uint32_t(txBuffer.size() - offset_B);
+        if (available_B == 0) {
+            break;
+        }
+        const uint32_t written_B = writeMetaChunk(now_us, &txBuffer[offset_B], available_B);
+        assert(written_B <= available_B);
+        if (written_B <= 0) {
+            break;
+        }
+        offset_B += written_B;
+    }
     txBuffer.resize(offset_B);
     do {
         if (isTestBandwidthEnabled) {
@@ -171,6 +195,9 @@ bool UDSPSocket::Connection::writePacket(
     }
 
     header.PMTUProbeSize_B = uint16_t(PMTUProbeResponse_B);
+    rxPacketsLossSent_prc100 = header.packetsLoss_prc100;
+    RTTResponseSent = header.RTTResponse;
+    isTxInRxWindow = true;
     return true;
 }
 void UDSPSocket::Connection::writePMTUProbe() {
@@ -196,18 +223,118 @@ void UDSPSocket::Connection::writeDisconnect() {
     header.packetId = PacketId::Disconnect;
 }
 
+bool UDSPSocket::Connection::isIdle(const bool isTestBandwidthEnabled) const {
+    if (isDisconnectRequested or not rxStreams.ackStreams.empty()) {
+        return false;
+    }
+    if (isTestBandwidthEnabled and isConnected()) {
+        return false;
+    }
+    for (const auto& it : txStreams.map) {
+        if (it.second.isNew or not it.second.fifo.empty()) {
+            return false;
+        }
+    }
+    for (const auto& it : rxStreams.map) {
+        if (not it.second.fifo.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+int64_t UDSPSocket::Connection::getNextDeadline_us() const {
+    int64_t deadline_us = std::min(nextKeepAliveTick_us, nextEraseTick_us);
+    if (isConnected()) {
+        deadline_us = std::min(deadline_us, nextPMTUProbe_us);
+        deadline_us = std::min(deadline_us, next1Hz_us);
+        deadline_us = std::min(deadline_us, lastPacketTick_us + g_connectionTimeout_us);
+        if (PMTU_B != g_basePMTU_IPv4_B) {
+            deadline_us = std::min(deadline_us, lastPacketTick_us + g_connectionTimeout_us / 2);
+        }
+    }
+    return deadline_us;
+}
+
+void UDSPSocket::Impl::notify_ts(Connection& c) {
+    if (not c.isNotified.exchange(true) and not notifiedConnections.push(uint64_t(c.key))) {
+        isNotifyOverflow = true;
+    }
+    udpSocket.wakeup();
+}
+void UDSPSocket::Impl::activate(Connection& c, const int64_t now_us) {
+    if (c.isActive) {
+        return;
+    }
+    c.isActive = true;
+    c.nextTimer_us = INT64_MAX;
+    activeConnections.push_back(&c);
+    // The pacing portion is not accumulated while idle
+    if (c.prevTick_us != 0) {
+        c.prevTick_us = std::max(c.prevTick_us, now_us - 10 * 1000);
+    }
+}
+void UDSPSocket::Impl::deactivate(const size_t activeIdx) {
+    auto& c = *activeConnections[activeIdx];
+    c.isActive = false;
+    c.nextTimer_us = c.getNextDeadline_us();
+    timers.schedule(c.key, c.nextTimer_us);
+    activeConnections[activeIdx] = activeConnections.back();
+    activeConnections.pop_back();
+}
+uint32_t UDSPSocket::Impl::getWaitTimeout_ms() const {
+    if (not activeConnections.empty()) {
+        return 10;
+    }
+    const int64_t deadline_us = timers.getNextDeadline_us();
+    if (deadline_us == INT64_MAX) {
+        return 100;
+    }
+    const int64_t wait_us = deadline_us - tick_us();
+    if (wait_us <= 0) {
+        return 0;
+    }
+    return uint32_t(std::min<int64_t>((wait_us + 999) / 1000, 100));
+}
+
 void UDSPSocket::Impl::process_ts() {
     const int64_t now_us = tick_us();
     std::lock_guard<std::mutex> lock(mutex);
 
-    for (auto connectionIt = connections.begin(); connectionIt != connections.end();) {
-        auto& c = *connectionIt->second;
+    uint64_t key = 0;
+    while (notifiedConnections.pop(key)) {
+        auto it = connections.find(key);
+        if (it == connections.end() or it->second == nullptr) {
+            continue;
+        }
+        it->second->isNotified = false;
+        activate(*it->second, now_us);
+    }
+    if (isNotifyOverflow.exchange(false)) {
+        for (auto& it : connections) {
+            it.second->isNotified = false;
+            activate(*it.second, now_us);
+        }
+    }
+    timers.expire(now_us, [this, now_us](const uint64_t key, const int64_t deadline_us) {
+        auto it = connections.find(key);
+        if (it == connections.end() or it->second == nullptr) {
+            return;
+        }
+        // Outdated entries of the rescheduled connections
+        if (it->second->nextTimer_us != deadline_us) {
+            return;
+        }
+        activate(*it->second, now_us);
+    });
+
+    for (size_t i = 0; i < activeConnections.size();) {
+        auto& c = *activeConnections[i];
 
         c.doCommands();
 
         if (c.isDisconnectRequested) {
             c.writeDisconnect();
-            udpSocket.send(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
+            udpSocket.enqueue(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
 
             c.onDisconnected();
 #         if UDSP_TRACE_LEVEL >= UDSP_TRACE_LEVEL_STATE_CHANGED
@@ -217,12 +344,14 @@ void UDSPSocket::Impl::process_ts() {
             if (onDisconnected != nullptr) {
                 onDisconnected(&c, 'c');
             }
-            auto toRemove = connectionIt++;
-            connections.erase(toRemove);
+            activeConnections[i] = activeConnections.back();
+            activeConnections.pop_back();
+            updateTxLimitsSum(c, true);
+            connections.erase(c.key);
             continue;
         }
         else if (c.nextEraseTick_us == INT64_MAX) {
-            ++connectionIt;
+            ++i;
             if (c.lastPacketTick_us <= now_us - g_connectionTimeout_us) {
                 c.nextEraseTick_us = now_us + 2 * 1000 * 1000;
                 c.lastPacketTick_us = INT64_MAX;
@@ -240,11 +369,13 @@ void UDSPSocket::Impl::process_ts() {
         }
         else if (c.nextEraseTick_us <= now_us) {
             if (isServer) {
-                auto toRemove = connectionIt++;
-                connections.erase(toRemove);
+                activeConnections[i] = activeConnections.back();
+                activeConnections.pop_back();
+                updateTxLimitsSum(c, true);
+                connections.erase(c.key);
             }
             else {
-                ++connectionIt;
+                ++i;
                 c.partialReset();
                 c.nextEraseTick_us = INT64_MAX;
                 c.lastPacketTick_us = INT64_MAX;
@@ -252,7 +383,7 @@ void UDSPSocket::Impl::process_ts() {
             continue;
         }
         else { // waiting for erase
-            ++connectionIt;
+            ++i;
             continue;
         }
     }
@@ -260,13 +391,18 @@ void UDSPSocket::Impl::process_ts() {
 void UDSPSocket::Impl::process() {
     while (isRunning) {
         ++TPS;
-        udpSocket.process(10);
-        //udpSocket.process(1);
+        if (isIoUringEnabled != udpSocket.getIoUring()) {
+            if (not udpSocket.setIoUring(isIoUringEnabled)) {
+                isIoUringEnabled = false;
+            }
+        }
+        // Nothing to pace, so it sleeps until the nearest deadline or a wakeup
+        udpSocket.process(getWaitTimeout_ms());
 
         process_ts();
 
-        for (auto& it : connections) {
-            auto& c = *it.second;
+        for (size_t i = 0; i < activeConnections.size();) {
+            auto& c = *activeConnections[i];
             const int64_t now_us = tick_us();
 
             if (c.lastPacketTick_us != INT64_MAX) {
@@ -276,7 +412,7 @@ void UDSPSocket::Impl::process() {
             if (c.nextKeepAliveTick_us <= now_us) {
                 //c.writeHeader().packetId = PacketId::TypeA;
                 c.writePacket(false, true);
-                udpSocket.send(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
+                udpSocket.enqueue(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
                 c.nextKeepAliveTick_us = now_us + g_keepAlivePeriod_us;
                 const uint32_t sent_B = uint32_t(c.txBuffer.size()) + g_headerSize_IPv4_B;
                 c.txCount_B += sent_B;
@@ -290,9 +426,46 @@ void UDSPSocket::Impl::process() {
             }
 
             spent_us += tick_us() - now_us;
+            updateTxLimitsSum(c);
+
+            if (c.isIdle(isTestBandwidthEnabled)) {
+                deactivate(i);
+            }
+            else {
+                ++i;
+            }
         }
+        udpSocket.flush();
+        updateMaxPacingRate();
     }
 }
+void UDSPSocket::Impl::updateMaxPacingRate() {
+    if (not isMaxPacingRateEnabled) {
+        if (maxPacingRate_B_s != UINT32_MAX) {
+            maxPacingRate_B_s = UINT32_MAX;
+            udpSocket.setMaxPacingRate_B_s(maxPacingRate_B_s);
+        }
+        return;
+    }
+    // One socket for all connections on the server, so the cap is the sum of their limits
+    const uint64_t sum_B_s = txLimitsSum_B_s;
+    const uint32_t rate_B_s = sum_B_s == 0 or sum_B_s >= UINT32_MAX
+        ? UINT32_MAX : uint32_t(sum_B_s);
+    // The limit changes on almost every feedback, so skip changes below 1/16
+    const uint32_t diff_B_s = rate_B_s > maxPacingRate_B_s
+        ? rate_B_s - maxPacingRate_B_s : maxPacingRate_B_s - rate_B_s;
+    if (diff_B_s <= std::min(rate_B_s, maxPacingRate_B_s) / 16) {
+        return;
+    }
+    if (udpSocket.setMaxPacingRate_B_s(rate_B_s)) {
+        maxPacingRate_B_s = rate_B_s;
+    }
+}
+void UDSPSocket::Impl::updateTxLimitsSum(Connection& c, const bool isErased) {
+    const uint32_t limit_B_s = c.isConnected() and not isErased ? c.txLimit_B_s : 0;
+    txLimitsSum_B_s = txLimitsSum_B_s - c.summedTxLimit_B_s + limit_B_s;
+    c.summedTxLimit_B_s = limit_B_s;
+}
 void UDSPSocket::Impl::processConnection(Connection& c, const int64_t now_us) {
     //if (now_us < c.nextProcess_us) {
     //    return;
@@ -325,7 +498,7 @@ void UDSPSocket::Impl::processConnection(Connection& c, const int64_t now_us) {
             c.nextPMTUProbe_us = now_us + g_PMTUProbePeriod_us;
             // Search Phase
             c.writePMTUProbe();
-            udpSocket.send(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
+            udpSocket.enqueue(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
             //std::cout << CLR_MAGENTA "Search Phase " << c.PMTU_B << " + "
             //    << c.PMTUProbeStep_B << CLR_RESET << std::endl;
         }
@@ -354,8 +527,17 @@ void UDSPSocket::Impl::processConnection(Connection& c, const int64_t now_us) {
         if (not c.writePacket(isTestBandwidthEnabled, false)) {
             break;
         }
-        udpSocket.send(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
-        txCount_B += uint32_t(c.txBuffer.size()) + g_headerSize_IPv4_B;
+        const uint32_t sent_B = uint32_t(c.txBuffer.size()) + g_headerSize_IPv4_B;
+        int64_t departure_us = 0;
+        if (isTxTimePacingEnabled) {
+            // Spread the portion evenly instead of bursting it, the kernel holds
+            // each datagram until its departure time.
+            departure_us = std::max(now_us, c.nextDeparture_us);
+            c.nextDeparture_us = departure_us + (int64_t(sent_B) * 1000000) / c.txLimit_B_s;
+        }
+        udpSocket.enqueue(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4,
+            departure_us);
+        txCount_B += sent_B;
 
 #     if UDSP_TRACE_LEVEL >= UDSP_TRACE_LEVEL_TX_PACING
         std::cout << CLR_YELLOW << __LINE__ << " send id=" << c.txPacketsCount
@@ -390,6 +572,11 @@ void UDSPSocket::Impl::processConnection(Connection& c, const int64_t now_us) {
         c.rxSpeed_B_s = c.rxCount_B_s;
         c.rxCount_B_s = 0;
 
+        // Repeated in case of a loss, the reset to the default too
+        if (c.isAckFrequencySet) {
+            c.isAckFrequencyChanged = true;
+        }
+
         if (c.txPacketsLossSum_count == 0) {
             c.txPacketsLoss_prc = 0.0f;
         }
@@ -486,6 +673,20 @@ void UDSPSocket::Impl::processConnection(Connection& c, const int64_t now_us) {
         else {
             std::cout << load_prc;
         }
+        const auto& rxBatch = udpSocket.getRxBatchStatistics();
+        const uint64_t rxBatchCalls = rxBatch.callsCount - debugRxBatchStatistics.callsCount;
+        std::cout << CLR_DARKGRAY " RxBatch=" CLR_WHITE << std::setprecision(1)
+            << (rxBatchCalls == 0 ? 0.0f : float(rxBatch.datagramsCount
+                - debugRxBatchStatistics.datagramsCount) / float(rxBatchCalls))
+            << CLR_DARKGRAY "," CLR_WHITE << rxBatch.maxBatchSize;
+        debugRxBatchStatistics = rxBatch;
+        const auto& txBatch = udpSocket.getTxBatchStatistics();
+        const uint64_t txBatchCalls = txBatch.callsCount - debugTxBatchStatistics.callsCount;
+        std::cout << CLR_DARKGRAY " TxBatch=" CLR_WHITE
+            << (txBatchCalls == 0 ? 0.0f : float(txBatch.datagramsCount
+                - debugTxBatchStatistics.datagramsCount) / float(txBatchCalls))
+            << CLR_DARKGRAY "," CLR_WHITE << txBatch.maxBatchSize;
+        debugTxBatchStatistics = txBatch;
         std::cout << CLR_DARKGRAY " MQ=R:" CLR_WHITE << c.debugMaxRxQueue
             << CLR_DARKGRAY ",T:" CLR_WHITE << c.debugMaxTxQueue;
         c.debugMaxRxQueue = 0;
@@ -537,6 +738,7 @@ void UDSPSocket::Impl::onUdpReceived(void* data, uint32_t size_B, uint16_t port,
             if (onDisconnected != nullptr) {
                 onDisconnected(&*connectionIt->second, 'c');
             }
+            activate(*connectionIt->second, now_us);
         }
         return;
     }
@@ -581,6 +783,7 @@ void UDSPSocket::Impl::onUdpReceived(void* data, uint32_t size_B, uint16_t port,
         //c.RTTSmooth_us.init(0.05f, 0.05f);
     }
     c.lastPacketTick_us = now_us;
+    activate(c, now_us);
 
     if (header.RTTResponse == c.RTTRequest and c.RTTRequestTick_us > 0) {
         int64_t RTT_us = now_us - c.RTTRequestTick_us - header.RTTDelay_us;
@@ -766,8 +969,18 @@ void UDSPSocket::Impl::onUdpReceived(void* data, uint32_t size_B, uint16_t port,
             << " loss=" << c.rxPacketsLossInWindow_prc100 * 0.01f <<"\n";
 #     endif // UDSP_TRACE_LEVEL
 
+        // The acks go with any datagram, so they alone don't force one if something
+        // was sent since the previous change. The new loss or RTT response does.
+        const bool isFeedbackPending =
+            c.rxPacketsLossInWindow_prc100 != c.rxPacketsLossSent_prc100
+            or c.RTTResponse != c.RTTResponseSent;
+        if (c.isTxInRxWindow and not isFeedbackPending) {
+            c.isTxInRxWindow = false;
+            return;
+        }
         c.writePacket(false, true);
-        udpSocket.send(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
+        c.isTxInRxWindow = false;
+        udpSocket.enqueue(c.txBuffer.data(), uint32_t(c.txBuffer.size()), c.port, c.IPv4);
         c.nextKeepAliveTick_us = now_us + g_keepAlivePeriod_us;
         const uint32_t sent_B = uint32_t(c.txBuffer.size()) + g_headerSize_IPv4_B;
         c.txCount_B += sent_B;
@@ -0,0 +1,112 @@
+#include "Crc32c.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) or defined(_M_X64)
+#   define UDSP_CRC32C_SSE42 1
+#   include <nmmintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   endif
+#elif defined(__aarch64__) and defined(__ARM_FEATURE_CRC32)
+#   define UDSP_CRC32C_ARMV8 1
+#   include <arm_acle.h>
+#endif
+
+
+namespace {
+    constexpr uint32_t g_polynomial = 0x82F63B78; // reflected 0x1EDC6F41
+
+    struct Tables {
+        uint32_t t[8][256];
+        Tables() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (uint32_t bit = 0; bit < 8; ++bit) {
+                    crc = (crc >> 1) ^ (g_polynomial & (0 - (crc & 1)));
+                }
+                t[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (uint32_t k = 1; k < 8; ++k) {
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+                }
+            }
+        }
+    };
+
+    uint32_t crc32cTables(uint32_t crc, const uint8_t* data, size_t size_B) {
+        static const Tables tables;
+        const auto& t = tables.t;
+        for (; size_B >= 8; size_B -= 8, data += 8) {
+            // Byte by byte - independent of the endianness
+            crc ^= uint32_t(data[0]) | uint32_t(data[1]) << 8
+                | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+            crc = t[7][crc & 0xFF] ^ t[6][(crc >> 8) & 0xFF]
+                ^ t[5][(crc >> 16) & 0xFF] ^ t[4][crc >> 24]
+                ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        }
+        for (; size_B != 0; --size_B, ++data) {
+            crc = t[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#if UDSP_CRC32C_SSE42
+#   ifndef _MSC_VER
+    __attribute__((target("sse4.2")))
+#   endif
+    uint32_t crc32cSse42(uint32_t crc, const uint8_t* data, size_t size_B) {
+        uint64_t crc64 = crc;
+        for (; size_B >= 8; size_B -= 8, data += 8) {
+            uint64_t value = 0;
+            std::memcpy(&value, data, 8);
+            crc64 = _mm_crc32_u64(crc64, value);
+        }
+        crc = uint32_t(crc64);
+        for (; size_B != 0; --size_B, ++data) {
+            crc = _mm_crc32_u8(crc, *data);
+        }
+        return crc;
+    }
+    bool isSse42() {
+#   ifdef _MSC_VER
+        int info[4] = {};
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#   else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+#   endif
+    }
+#elif UDSP_CRC32C_ARMV8
+    uint32_t crc32cArmv8(uint32_t crc, const uint8_t* data, size_t size_B) {
+        for (; size_B >= 8; size_B -= 8, data += 8) {
+            uint64_t value = 0;
+            std::memcpy(&value, data, 8);
+            crc = __crc32cd(crc, value);
+        }
+        for (; size_B != 0; --size_B, ++data) {
+            crc = __crc32cb(crc, *data);
+        }
+        return crc;
+    }
+#endif
+
+    using Function = uint32_t (*)(uint32_t crc, const uint8_t* data, size_t size_B);
+    Function getFunction() {
+#if UDSP_CRC32C_SSE42
+        if (isSse42()) {
+            return crc32cSse42;
+        }
+#elif UDSP_CRC32C_ARMV8
+        return crc32cArmv8;
+#endif
+        return crc32cTables;
+    }
+}
+
+uint32_t crc32c(const uint32_t crc, const void* data, size_t size_B) {
+    static const Function function = getFunction();
+    return ~function(~crc, static_cast<const uint8_t*>(data), size_B);
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// CRC32C (Castagnoli) by the SSE4.2 or ARMv8 CRC32 instructions if available,
+// otherwise by the tables (slicing-by-8).
+// Incremental: crc32c(crc32c(0, a, aSize_B), b, bSize_B) == crc32c(0, ab, aSize_B + bSize_B)
+uint32_t crc32c(const uint32_t crc, const void* data, size_t size_B);
@@ -23,6 +23,7 @@ UDSPSocket::Impl::~Impl() {
 }
 void UDSPSocket::Impl::stop() {
     isRunning = false;
+    udpSocket.wakeup();
     if (thread.joinable()) {
         thread.join();
     }
@@ -56,6 +57,7 @@ UDSPSocket::Connection& UDSPSocket::Impl::serverConnection(const uint64_t connec
     auto& ptr = connections[connectionId];
     if (ptr == nullptr) {
         ptr = std::make_unique<Connection>(this);
+        ptr->key = connectionId;
     }
     return *ptr;
 }
@@ -64,6 +66,7 @@ bool UDSPSocket::Impl::initConnection(Connection& c, const uint16_t port, const
     c.port = port;
     c.IPv4 = IPv4;
     c.partialReset();
+    notify_ts(c);
     return true;
 }
 
@@ -83,6 +86,8 @@ bool UDSPSocket::Impl::connect(const uint16_t port, const uint32_t IPv4) {
 #     endif // UDSP_TRACE_LEVEL
         assert(false);
     }
+    udpSocket.setTxSegmentationOffload(true);
+    udpSocket.setRxCoalescingOffload(true);
 
     std::lock_guard<std::mutex> lock(mutex);
     if (isServer) {
@@ -116,6 +121,7 @@ bool UDSPSocket::Impl::disconnect() {
     std::lock_guard<std::mutex> lock(mutex);
     if (not connections.empty() and connections.begin()->second != nullptr) {
         connections.begin()->second->isDisconnectRequested = true;
+        notify_ts(*connections.begin()->second);
     }
     return true;
 }
@@ -130,7 +136,13 @@ bool UDSPSocket::Impl::isConnected() {
     return clientConnection().isConnected();
 }
 
-bool UDSPSocket::Impl::listen(const uint16_t port) {
+bool UDSPSocket::Impl::listen(const uint16_t port, const bool isShared) {
+    if (isShared and not udpSocket.setReusePort(true)) {
+        return false;
+    }
+    if (not isShared) {
+        udpSocket.setReusePort(false);
+    }
     if (not udpSocket.bind(port)) {
         return false;
     }
@@ -149,16 +161,33 @@ bool UDSPSocket::Impl::listen(const uint16_t port) {
 #     endif // UDSP_TRACE_LEVEL
         assert(false);
     }
+    udpSocket.setTxSegmentationOffload(true);
+    udpSocket.setRxCoalescingOffload(true);
+    if (isTxTimePacingEnabled) {
+        udpSocket.setTxTimePacing(true); // the socket is re-created by bind
+    }
 
     std::lock_guard<std::mutex> lock(mutex);
     if (not isServer and not connections.empty()) {
         connections.begin()->second->onDisconnected();
         connections.clear();
+        activeConnections.clear();
+        txLimitsSum_B_s = 0;
     }
     localPort = udpSocket.getLocalPort();
     isServer = true;
     return true;
 }
+void UDSPSocket::Impl::copySettings(const Impl& other) {
+    onConnected = other.onConnected;
+    onDisconnected = other.onDisconnected;
+    rxPacketBufferSizeThreshold_B = other.rxPacketBufferSizeThreshold_B;
+    isTestBandwidthEnabled = other.isTestBandwidthEnabled;
+    isTxTimePacingEnabled = other.isTxTimePacingEnabled;
+    isMaxPacingRateEnabled = other.isMaxPacingRateEnabled;
+    isIoUringEnabled = other.isIoUringEnabled;
+    isDeadlineSchedulingEnabled = other.isDeadlineSchedulingEnabled;
+}
 
 UDSPSocket::UDSPSocket() {
     m_impl = std::make_unique<Impl>();
@@ -167,12 +196,16 @@ UDSPSocket::~UDSPSocket() {
 }
 void UDSPSocket::stop() {
     m_impl->stop();
+    for (auto& shard : m_shards) {
+        shard->stop();
+    }
 }
 
 bool UDSPSocket::connect(const uint16_t port, const IPAddress& address) {
     if (not address.isV4()) {
         return false;
     }
+    m_shards.clear();
     return m_impl->connect(port, address.toIntegerV4());
 }
 bool UDSPSocket::disconnect() {
@@ -182,14 +215,46 @@ bool UDSPSocket::isConnected() const {
     return m_impl->isConnected();
 }
 
-bool UDSPSocket::listen(const uint16_t port) {
-    return m_impl->listen(port);
+bool UDSPSocket::listen(const uint16_t port, const uint32_t threadsCount) {
+    m_shards.clear();
+# ifdef _WIN32
+    const bool isShared = false; // SO_REUSEPORT doesn't balance on Windows
+# else
+    const bool isShared = threadsCount > 1;
+# endif
+    if (not m_impl->listen(port, isShared)) {
+        return false;
+    }
+    if (not isShared) {
+        return true;
+    }
+    for (uint32_t i = 1; i < threadsCount; ++i) {
+        auto shard = std::make_unique<Impl>();
+        shard->copySettings(*m_impl);
+        if (not shard->listen(m_impl->localPort, true)) {
+            m_shards.clear();
+            return false;
+        }
+        m_shards.push_back(std::move(shard));
+    }
+    // Keeps a connection on its worker even if the peer address changes,
+    // otherwise the kernel hashes by the 4-tuple
+    m_impl->udpSocket.setReusePortSteering(
+        offsetof(PacketHeader, connectionId), threadsCount
+    );
+    return true;
 }
 
 void UDSPSocket::setOnConnected(std::function<void(Connection*)>&& onConnected) {
+    for (auto& shard : m_shards) {
+        shard->onConnected = onConnected;
+    }
     m_impl->onConnected = std::move(onConnected);
 }
 void UDSPSocket::setOnDisconnected(std::function<void(Connection*, char)>&& onDisconnected) {
+    for (auto& shard : m_shards) {
+        shard->onDisconnected = onDisconnected;
+    }
     m_impl->onDisconnected = std::move(onDisconnected);
 }
 
@@ -207,7 +272,35 @@ uint16_t UDSPSocket::getPeerPort(Connection* connection) const {
 }
 
 void UDSPSocket::setTxStreamPriority(Connection* connection, uint8_t txStreamId, char priority) {
-    m_impl->setTxStreamPriority_ts(connection, txStreamId, priority);
+    if (connection == nullptr) {
+        return;
+    }
+    connection->impl->setTxStreamPriority_ts(connection, txStreamId, priority);
+}
+void UDSPSocket::setTxStreamWeight(Connection* connection, uint8_t txStreamId, uint32_t weight) {
+    if (connection == nullptr) {
+        return;
+    }
+    connection->impl->setTxStreamWeight_ts(connection, txStreamId, weight);
+}
+void UDSPSocket::setTxStreamFecState(Connection* connection, uint8_t txStreamId,
+        bool isEnabled) {
+    if (connection == nullptr) {
+        return;
+    }
+    connection->impl->setTxStreamFecState_ts(connection, txStreamId, isEnabled);
+}
+void UDSPSocket::setTxQuantum_B(Connection* connection, uint32_t quantum_B) {
+    if (connection == nullptr or quantum_B == 0) {
+        return;
+    }
+    connection->impl->setTxQuantum_ts(connection, quantum_B);
+}
+uint32_t UDSPSocket::getTxQuantum_B(Connection* connection) const {
+    if (connection == nullptr) {
+        return 0;
+    }
+    return connection->txQuantum_B;
 }
 //char UDSPSocket::getTxStreamPriority(Connection* connection, uint8_t txStreamId) const {
 //    return m_impl->getTxStreamPriority_ts(connection, txStreamId);
@@ -215,7 +308,39 @@ void UDSPSocket::setTxStreamPriority(Connection* connection, uint8_t txStreamId,
 
 bool UDSPSocket::send(uintptr_t context, Connection* connection, const void* data,
         uint64_t size_B, bool copy, uint8_t streamId, uint32_t timeout_ms) {
-    return m_impl->send_ts(context, connection, data, size_B, copy, streamId, timeout_ms, tick_us());
+    if (connection == nullptr) {
+        return false;
+    }
+    return connection->impl->send_ts(
+        context, connection, data, size_B, copy, streamId, timeout_ms, tick_us()
+    );
+}
+bool UDSPSocket::send(uintptr_t context, Connection* connection, std::vector<uint8_t>&& data,
+        uint8_t streamId, uint32_t timeout_ms) {
+    if (connection == nullptr) {
+        return false;
+    }
+    return connection->impl->send_ts(
+        context, connection, std::move(data), streamId, timeout_ms, tick_us()
+    );
+}
+bool UDSPSocket::send(uintptr_t context, Connection* connection, Buffer&& data,
+        uint64_t size_B, uint8_t streamId, uint32_t timeout_ms) {
+    if (connection == nullptr) {
+        return false;
+    }
+    return connection->impl->send_ts(
+        context, connection, std::move(data), size_B, streamId, timeout_ms, tick_us()
+    );
+}
+bool UDSPSocket::send(uintptr_t context, Connection* connection,
+        const std::vector<Segment>& segments, bool copy, uint8_t streamId, uint32_t timeout_ms) {
+    if (connection == nullptr) {
+        return false;
+    }
+    return connection->impl->send_ts(
+        context, connection, segments, copy, streamId, timeout_ms, tick_us()
+    );
 }
 
 void UDSPSocket::setOnDelivered(Connection* connection, std::function<void(
@@ -225,14 +350,29 @@ void UDSPSocket::setOnDelivered(Connection* connection, std::function<void(
     //m_impl->onDelivered = std::move(onDelivered);
     //connection->onDelivered = std::move(onDelivered);
 
-    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    std::lock_guard<std::mutex> lock(connection->impl->mutex);
     connection->commands.emplace_back([connection, on = std::move(onDelivered)] {
         connection->onDelivered = std::move(on);
     });
+    connection->impl->notify_ts(*connection);
+}
+
+void UDSPSocket::setOnSend(Connection* connection, std::function<void(
+            uintptr_t context, Connection* connection, uint64_t readOffset_B,
+            uint32_t pieceSize_B, uint8_t* writeBuffer, uint8_t txStreamId
+        )>&& onSend) {
+    std::lock_guard<std::mutex> lock(connection->impl->mutex);
+    connection->commands.emplace_back([connection, on = std::move(onSend)] {
+        connection->onSend = std::move(on);
+    });
+    connection->impl->notify_ts(*connection);
 }
 
 void UDSPSocket::setRxPacketBufferSizeThreshold_B(const uint32_t threshold_B) {
     m_impl->rxPacketBufferSizeThreshold_B = threshold_B;
+    for (auto& shard : m_shards) {
+        shard->rxPacketBufferSizeThreshold_B = threshold_B;
+    }
 }
 
 void UDSPSocket::setOnReceived(Connection* connection, std::function<uintptr_t(
@@ -242,10 +382,11 @@ void UDSPSocket::setOnReceived(Connection* connection, std::function<uintptr_t(
     //m_impl->onReceived = std::move(onReceived);
     //connection->onReceived = std::move(onReceived);
 
-    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    std::lock_guard<std::mutex> lock(connection->impl->mutex);
     connection->commands.emplace_back([connection, on = std::move(onReceived)] {
         connection->onReceived = std::move(on);
     });
+    connection->impl->notify_ts(*connection);
 }
 
 void UDSPSocket::setTxSpeedLimit_B_s(Connection* connection, uint32_t limit_B_s) {
@@ -260,6 +401,23 @@ uint32_t UDSPSocket::getTxSpeedLimit_B_s(Connection* connection) const {
     }
     return connection->desiredTxLimit_B_s;
 }
+void UDSPSocket::setAckFrequency(Connection* connection, uint8_t ackEveryN,
+        uint32_t maxAckDelay_us) {
+    if (connection == nullptr) {
+        return;
+    }
+    if (ackEveryN == 0) {
+        ackEveryN = 1;
+    }
+    std::lock_guard<std::mutex> lock(connection->impl->mutex);
+    connection->commands.emplace_back([connection, ackEveryN, maxAckDelay_us] {
+        connection->peerAckEveryN = ackEveryN;
+        connection->peerMaxAckDelay_us = maxAckDelay_us;
+        connection->isAckFrequencyChanged = true;
+        connection->isAckFrequencySet = true;
+    });
+    connection->impl->notify_ts(*connection);
+}
 
 uint32_t UDSPSocket::getRxSpeed_B_s(Connection* connection) const {
     if (connection == nullptr) {
@@ -292,12 +450,74 @@ uint32_t UDSPSocket::getRTT_us(Connection* connection) const {
     return connection->RTT_us;
 }
 uint32_t UDSPSocket::getTPS() const {
-    return m_impl->TPS;
+    uint32_t TPS = m_impl->TPS;
+    for (const auto& shard : m_shards) {
+        TPS += shard->TPS;
+    }
+    return TPS;
 }
 
 void UDSPSocket::setTestBandwidthState(const bool isEnabled) {
     m_impl->isTestBandwidthEnabled = isEnabled;
+    for (auto& shard : m_shards) {
+        shard->isTestBandwidthEnabled = isEnabled;
+    }
 }
 bool UDSPSocket::getTestBandwidthState() const {
     return m_impl->isTestBandwidthEnabled;
 }
+
+bool UDSPSocket::setTxTimePacingState(const bool isEnabled) {
+    if (not m_impl->udpSocket.setTxTimePacing(isEnabled)) {
+        return false;
+    }
+    m_impl->isTxTimePacingEnabled = isEnabled;
+    for (auto& shard : m_shards) {
+        shard->udpSocket.setTxTimePacing(isEnabled);
+        shard->isTxTimePacingEnabled = isEnabled;
+    }
+    return true;
+}
+bool UDSPSocket::getTxTimePacingState() const {
+    return m_impl->isTxTimePacingEnabled;
+}
+
+bool UDSPSocket::setMaxPacingRateState(const bool isEnabled) {
+# if defined(__linux__)
+    m_impl->isMaxPacingRateEnabled = isEnabled;
+    for (auto& shard : m_shards) {
+        shard->isMaxPacingRateEnabled = isEnabled;
+    }
+    return true;
+# else
+    return not isEnabled;
+# endif
+}
+bool UDSPSocket::getMaxPacingRateState() const {
+    return m_impl->isMaxPacingRateEnabled;
+}
+
+bool UDSPSocket::setIoUringState(const bool isEnabled) {
+# if defined(__linux__)
+    m_impl->isIoUringEnabled = isEnabled;
+    for (auto& shard : m_shards) {
+        shard->isIoUringEnabled = isEnabled;
+    }
+    return true;
+# else
+    return not isEnabled;
+# endif
+}
+bool UDSPSocket::getIoUringState() const {
+    return m_impl->isIoUringEnabled;
+}
+
+void UDSPSocket::setDeadlineSchedulingState(const bool isEnabled) {
+    m_impl->isDeadlineSchedulingEnabled = isEnabled;
+    for (auto& shard : m_shards) {
+        shard->isDeadlineSchedulingEnabled = isEnabled;
+    }
+}
+bool UDSPSocket::getDeadlineSchedulingState() const {
+    return m_impl->isDeadlineSchedulingEnabled;
+}
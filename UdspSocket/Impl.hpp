@@ -1,13 +1,16 @@
 #pragma once
 #include "UdspSocket.hpp"
 #include "UdpSocket.hpp"
+#include "Crc32c.hpp"
 
 #include <cassert>
 #include <random>
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <deque>
+#include <queue>
 #include <vector>
 #include <array>
 #include <unordered_map>
@@ -75,6 +78,175 @@ private:
     float m_prevBt = 0.0f;
 };
 
+// Bounded multi-producer single-consumer queue of sequence-numbered cells (D. Vyukov).
+// push() is wait-free and allocation-free: a cell is reserved by fetch_add on the size
+// and taken by fetch_add on the tail, without retries. pop() must be called by one thread
+// at a time. The size and the sequences are seq_cst, so a reserved cell is always released.
+template <typename value_t, uint32_t capacity>
+class MPSCQueue {
+    static_assert(capacity >= 2 and (capacity & (capacity - 1)) == 0, "power of 2");
+public:
+    MPSCQueue() : m_cells(capacity) {
+        for (uint32_t i = 0; i < capacity; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+    MPSCQueue(const MPSCQueue& other) = delete;
+    MPSCQueue& operator=(const MPSCQueue& other) = delete;
+
+    // false - the queue is full
+    bool push(value_t&& value) {
+        return pushWith([&value](value_t& cell, const uint32_t) {
+            cell = std::move(value);
+        });
+    }
+    // write(value_t& cell, uint32_t cellIdx) fills the taken cell, cellIdx < capacity
+    template <typename write_t>
+    bool pushWith(const write_t& write) {
+        if (m_size.fetch_add(1) >= capacity) {
+            --m_size;
+            return false;
+        }
+        const uint32_t position = m_tail.fetch_add(1);
+        Cell& cell = m_cells[position & (capacity - 1)];
+        // The previous value is popped, there are no more reservations than cells
+        const uint32_t sequence = cell.sequence.load();
+        assert(sequence == position);
+        (void)sequence;
+        write(cell.value, position & (capacity - 1));
+        cell.sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+    // false - the queue is empty, or its front is still being written
+    bool pop(value_t& value) {
+        return popWith([&value](value_t& cell, const uint32_t) {
+            value = std::move(cell);
+        });
+    }
+    // read(value_t& cell, uint32_t cellIdx) takes the front cell before it is released
+    template <typename read_t>
+    bool popWith(const read_t& read) {
+        const uint32_t cellIdx = m_head & (capacity - 1);
+        Cell& cell = m_cells[cellIdx];
+        const uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (int32_t(sequence - (m_head + 1)) < 0) {
+            return false;
+        }
+        read(cell.value, cellIdx);
+        cell.sequence.store(m_head + capacity);
+        ++m_head;
+        --m_size;
+        return true;
+    }
+    // Including the cells taken, but not written yet
+    bool isEmpty() const {
+        return m_size == 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        value_t value;
+    };
+    std::vector<Cell> m_cells;
+    alignas(64) std::atomic<uint32_t> m_size{ 0 };
+    alignas(64) std::atomic<uint32_t> m_tail;
+    alignas(64) uint32_t m_head = 0;
+};
+
+// Hierarchical timing wheel: 256 slots by 1 ms, then 256 slots by 256 ms.
+// Rescheduled entries are not removed, the owner skips the outdated ones on expiration.
+class TimerWheel {
+public:
+    void schedule(const uint64_t key, const int64_t deadline_us) {
+        if (deadline_us == INT64_MAX) {
+            return;
+        }
+        if (m_current_ms == INT64_MIN) {
+            m_current_ms = tick_us() / 1000;
+        }
+        insert(Entry{ key, deadline_us });
+        ++m_count;
+    }
+    // onExpired(key, deadline_us) for each entry due by now_us
+    template <typename callback_t>
+    void expire(const int64_t now_us, callback_t&& onExpired) {
+        const int64_t now_ms = now_us / 1000;
+        while (m_count > 0 and m_current_ms < now_ms) {
+            ++m_current_ms;
+            if ((m_current_ms & g_mask) == 0) {
+                m_buffer.swap(m_level1[(m_current_ms >> g_bits) & g_mask]);
+                for (const auto& entry : m_buffer) {
+                    insert(entry);
+                }
+                m_buffer.clear();
+            }
+            m_buffer.swap(m_level0[m_current_ms & g_mask]);
+            m_count -= m_buffer.size();
+            for (const auto& entry : m_buffer) {
+                onExpired(entry.key, entry.deadline_us);
+            }
+            m_buffer.clear();
+        }
+        if (m_current_ms < now_ms) {
+            m_current_ms = now_ms;
+        }
+    }
+    // INT64_MAX - nothing is scheduled
+    int64_t getNextDeadline_us() const {
+        if (m_count == 0) {
+            return INT64_MAX;
+        }
+        for (int64_t ms = m_current_ms + 1; ms < m_current_ms + g_slots; ++ms) {
+            if (not m_level0[ms & g_mask].empty()) {
+                return ms * 1000;
+            }
+        }
+        for (int64_t round = 1; round < g_slots; ++round) {
+            const auto& slot = m_level1[((m_current_ms >> g_bits) + round) & g_mask];
+            if (slot.empty()) {
+                continue;
+            }
+            int64_t deadline_us = INT64_MAX;
+            for (const auto& entry : slot) {
+                deadline_us = std::min(deadline_us, entry.deadline_us);
+            }
+            return deadline_us;
+        }
+        return INT64_MAX;
+    }
+
+private:
+    static constexpr int64_t g_bits = 8;
+    static constexpr int64_t g_slots = 1 << g_bits;
+    static constexpr int64_t g_mask = g_slots - 1;
+    struct Entry {
+        uint64_t key;
+        int64_t deadline_us;
+    };
+    void insert(const Entry& entry) {
+        // Rounded up, so an entry never expires before its deadline
+        const int64_t deadline_ms = std::max(
+            (entry.deadline_us + 999) / 1000, m_current_ms + 1
+        );
+        if (deadline_ms - m_current_ms < g_slots) {
+            m_level0[deadline_ms & g_mask].push_back(entry);
+            return;
+        }
+        // The farthest ones are cascaded again until they fit
+        const int64_t round = std::min(
+            (deadline_ms >> g_bits) - (m_current_ms >> g_bits), g_slots - 1
+        );
+        m_level1[((m_current_ms >> g_bits) + round) & g_mask].push_back(entry);
+    }
+    std::array<std::vector<Entry>, g_slots> m_level0;
+    std::array<std::vector<Entry>, g_slots> m_level1;
+    std::vector<Entry> m_buffer;
+    int64_t m_current_ms = INT64_MIN;
+    size_t m_count = 0;
+};
+
 
 // [uint32:packedId][uint32:packetNumber][uint64:connectionId][uint16:PMTUProbeSize_B]
 // [uint16:packetsLoss_prc100][uint32:RTTDelay_us][uint8:RTTRequest][uint8:RTTResponse]
@@ -107,12 +279,23 @@ union ChunkId {
     enum class Type : uint8_t {
         // ...[uint?:packetSize_B][bytes:data]
         // ... - isAcknowledge == true
+        // ...[uint8:count]([uint16:gap][uint16:length])*count
+        //     - isAcknowledge == true and isRanges == true, gaps from the previous range end
+        // [uint8:chunkId][uint8:ackEveryN][uint32:maxAckDelay_us]
+        //     - isAcknowledge == true and isReliable == false, the requested ack frequency
+        // ...[uint8:count][uint?:paritySize_B][uint?:sizesXor][bytes:parity]
+        //     - isAcknowledge == true and isReliable == false and isRanges == true,
+        //     XOR parity (FEC) of the SmallPackets [packetId, packetId + count)
         SmallPacket,
         // ...[uint?:packetSize_B][uint32:crc32]
+        //     - crc32 is CRC32C of the whole packet if hasCRC32 == true
         BeginOfPacket,
         // ...[uint?:offset_B][uint?:pieceSize_B][bytes:data]
         PieceOfPacket,
         // ...[uint?:repeatOffset_B][uint?:repeatSize_B]
+        //     - repeatSize_B == 0 - to the end
+        // ...[uint8:count]([uint?:repeatOffset_B][uint?:repeatSize_B])*count
+        //     - isRanges == true, only the missing ranges
         RepeatInfo,
     };
     enum class Bits : uint8_t {
@@ -148,7 +331,7 @@ union ChunkId {
     } type;
     struct {
         Type chunkType : 2;
-        uint8_t _ : 1;
+        uint8_t isRanges : 1;
         uint8_t isAcknowledge : 1;
         uint8_t isReliable : 1;
         uint8_t isFront : 1;
@@ -156,7 +339,8 @@ union ChunkId {
     } smallPacket;
     struct {
         Type chunkType : 2;
-        uint8_t _ : 2;
+        uint8_t hasCRC32 : 1;
+        uint8_t _ : 1;
         uint8_t isReliable : 1;
         uint8_t isFront : 1;
         Bits packetSizeBits : 2;
@@ -171,7 +355,8 @@ union ChunkId {
     } pieceOfPacket;
     struct {
         Type chunkType : 2;
-        uint8_t _ : 2;
+        uint8_t isRanges : 1;
+        uint8_t _ : 1;
         Bits repeatOffsetBits : 2;
         Bits repeatSizeBits : 2;
         //Bits continueOffsetBits : 2;
@@ -192,82 +377,216 @@ enum class Priority : uint8_t {
 };
 struct TxPacket {
     std::vector<uint8_t> copy;
+    UDSPSocket::Buffer buffer; // owns the pointer if not empty
+    std::vector<UDSPSocket::Segment> segments; // gathered instead of the pointer
     const uint8_t* pointer = nullptr;
     uint64_t size_B = 0;
     uint64_t offset_B = 0;
     int64_t timeout_us = 0;
     int64_t begin_us = 0;
-    uint64_t datagramId = UINT64_MAX; // > uint32_t packetsTxCount
+    int64_t sent_us = 0; // of the last chunk, 0 - not sent completely yet
     uintptr_t context = 0;
     uint32_t id = 0;
+    uint32_t crc32 = 0;
     //Priority priority = Priority::None;
     bool isReliable = false;
     bool isAcknowledged = false;
     bool isStarted = false;
+    bool isLost = false; // in TxStream::retransmits
+    bool isPulled = false; // by Connection::onSend, pointer == nullptr
+    bool hasCRC32 = false; // crc32 is computed, by the first BeginOfPacket
+    // The ranges missed by the receiver, [offset_B, end_B), sent instead of the whole
+    // packet when it's lost
+    std::vector<std::pair<uint64_t, uint64_t>> repeats;
+    bool isRepeating() const {
+        return isLost and not repeats.empty();
+    }
 };
 struct TxStream {
-    int64_t fifoReturnTime_us = 0;
+    int64_t lossTime_us = INT64_MAX; // of the front sent packet
+    int64_t lossTimer_us = 0; // in TxStreams::lossTimers
+    int64_t largestAckedSent_us = 0;
     std::deque<TxPacket> fifo;
     std::deque<uint32_t> fifoShadow;
-    size_t packetFifoIdx = 0;
+    // The sent reliable packets in the order of sending: [sent_us, packetId]
+    std::deque<std::pair<int64_t, uint32_t>> inflight;
+    std::deque<uint32_t> retransmits; // the lost packets, sent before the new ones
+    size_t packetFifoIdx = 0; // the next packet to send for the first time
     //int64_t timeout_ms = 0;
+    int64_t deficit_B = 0; // of the current round
     uint32_t nextPacketId = 0;
+    uint32_t weight = 0; // 0 - by priority
     uint8_t id = 0;
     Priority priority = Priority::Medium;
     bool isNew = true;
     bool isReliable = true;
+    bool isReady = false; // in TxStreams::realtime or TxStreams::weighted
+    // FEC of an unreliable stream: XOR parity of a group of consecutive SmallPackets,
+    // sent in a later datagram than them. The packets wait for it to be acknowledged.
+    std::vector<uint8_t> fecParity;
+    uint64_t fecSizesXor = 0;
+    uint64_t fecDatagramId = 0; // of the last packet of the group
+    int64_t fecDeadline_us = 0; // to close the group
+    uint32_t fecFirstPacketId = 0;
+    uint8_t fecCount = 0; // in TxStreams::fecStreams if not 0
+    uint8_t fecGroupSize = 0; // by the loss when the group is started
+    bool isFecEnabled = false;
+    bool isFecClosed = false;
+
+    uint32_t getWeight() const {
+        if (weight != 0) {
+            return weight;
+        }
+        // high 80%, medium 16%, low 4%
+        switch (priority) {
+        case Priority::High:    return 20;
+        case Priority::Medium:  return 4;
+        default:                return 1;
+        }
+    }
+
+    bool hasNextPacket() const {
+        // To limit RX queue in the receiver side
+        return not retransmits.empty()
+            or (packetFifoIdx < fifo.size() and packetFifoIdx <= (1 << 17));
+    }
+    TxPacket* findPacket(const uint32_t packetId) {
+        if (fifo.empty()) {
+            return nullptr;
+        }
+        // The ids in the fifo are consecutive
+        const uint32_t packetIdx = packetId - fifoShadow.front();
+        return packetIdx < fifo.size() ? &fifo[packetIdx] : nullptr;
+    }
+    bool isInFecGroup(const uint32_t packetId) const {
+        return packetId - fecFirstPacketId < fecCount;
+    }
 };
 struct TxStreams {
     std::unordered_map<uint8_t, TxStream> map;
     decltype(map)::iterator streamIt = map.end();
 
     struct PriorityMeta {
-        std::vector<TxStream*> vec;
-        size_t vecIdx = 0;
         TxPacket* packet = nullptr;
         uint32_t countSent_B = 0;
     };
     std::array<PriorityMeta, size_t(Priority::_count_)> vec;
+    // The streams which may have a packet to send,
+    // the exhausted ones are removed lazily from the front.
+    std::deque<TxStream*> realtime; // round-robin by chunks
+    std::deque<TxStream*> weighted; // deficit round-robin
+    uint32_t quantum_B = 256; // per unit of weight
+    // The exhausted streams with unacknowledged packets: [lossTime_us, streamId]
+    std::priority_queue<
+        std::pair<int64_t, uint8_t>,
+        std::vector<std::pair<int64_t, uint8_t>>,
+        std::greater<std::pair<int64_t, uint8_t>>
+    > lossTimers;
+    std::vector<uint8_t> fecStreams; // with a group waiting for its parity
 
     bool isStreamsChanged = true;
 
+    void setReady(TxStream& stream) {
+        if (stream.isReady) {
+            return;
+        }
+        stream.isReady = true;
+        if (stream.priority == Priority::Realtime) {
+            realtime.push_back(&stream);
+        }
+        else {
+            weighted.push_back(&stream);
+        }
+    }
     void update() {
         if (not isStreamsChanged) {
             return;
         }
-        for (auto& it : vec) {
-            it.vec.clear();
-        }
+        realtime.clear();
+        weighted.clear();
         for (auto& it : map) {
-            vec[size_t(it.second.priority)].vec.push_back(&it.second);
+            it.second.isReady = false;
+            if (not it.second.fifo.empty()) {
+                setReady(it.second);
+            }
         }
         isStreamsChanged = false;
     }
+    void clear() {
+        map.clear();
+        realtime.clear();
+        weighted.clear();
+        lossTimers = decltype(lossTimers)();
+        fecStreams.clear();
+        isStreamsChanged = true;
+    }
 };
 
 struct RxPacket {
     std::vector<uint8_t> copy;
     //const uint8_t* pointer = nullptr;
     uint64_t size_B = 0;
-    uint64_t offset_B = 0;
-    uint64_t sizeRepeat_B = 0; // unimplemented
-    uint64_t offsetRepeat_B = UINT64_MAX;
+    uint64_t offset_B = 0; // received continuously
+    // Received after a gap into the copy, [offset_B, end_B)
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    uint64_t offsetRepeat_B = UINT64_MAX; // to the end
+    int64_t repeat_us = 0;
+    bool isGapsChanged = false; // before the ranges
     //uint64_t offsetContinue_B = UINT64_MAX;
     int64_t timeout_us = 0; // useful for unreliable streams
     uint64_t datagramId = UINT64_MAX; // > uint32_t packetsTxCount
     uintptr_t context = 0;
-    uint32_t crc32 = 0;
+    uint32_t crc32 = 0; // from BeginOfPacket
+    uint32_t crc32Streamed = 0; // of the pieces passed to onReceived
     uint32_t id = 0;
     bool isReliable = false;
     bool isReceived = false;
+    bool hasCRC32 = false;
+    bool isCorrupted = false; // CRC32 mismatch
     //bool isAcknowledged = true;
 
-    //  +++++--------------++++++-----------
-    // [    [^ sizeRepeat_B]     ^    size_B]
-    //       |                   |
-    //       offsetRepeat_B      offset_B
+    //  ++++++--------++++++-----+++++-----------
+    // [      ^ gap   [ranges]gap[    ]          size_B]
+    //        |
+    //        offset_B
     bool needToSendRepeatInfo() const {
-        return isReliable and offsetRepeat_B != UINT64_MAX;
+        return isReliable and (offsetRepeat_B != UINT64_MAX or isGapsChanged);
+    }
+    // When received completely, the streamed pieces are already counted
+    void checkCRC32() {
+        if (hasCRC32) {
+            isCorrupted = crc32 != (copy.empty()
+                ? crc32Streamed : crc32c(0, copy.data(), copy.size()));
+        }
+    }
+    // Returns true if the piece leaves a new gap before it
+    bool addRange(uint64_t begin_B, uint64_t end_B) {
+        bool isNewGap = false;
+        if (begin_B <= offset_B) {
+            offset_B = std::max(offset_B, end_B);
+        }
+        else {
+            isNewGap = ranges.empty() or ranges.back().second < begin_B;
+            size_t first = 0;
+            while (first < ranges.size() and ranges[first].second < begin_B) {
+                ++first;
+            }
+            size_t last = first;
+            while (last < ranges.size() and ranges[last].first <= end_B) {
+                begin_B = std::min(begin_B, ranges[last].first);
+                end_B = std::max(end_B, ranges[last].second);
+                ++last;
+            }
+            ranges.erase(ranges.begin() + first, ranges.begin() + last);
+            ranges.emplace(ranges.begin() + first, begin_B, end_B);
+        }
+        size_t merged = 0;
+        while (merged < ranges.size() and ranges[merged].first <= offset_B) {
+            offset_B = std::max(offset_B, ranges[merged].second);
+            ++merged;
+        }
+        ranges.erase(ranges.begin(), ranges.begin() + merged);
+        return isNewGap;
     }
 };
 struct RxStream {
@@ -275,6 +594,7 @@ struct RxStream {
     std::deque<RxPacket> fifo;
     std::deque<uint32_t> fifoShadow;
 public:
+    std::vector<uint32_t> acks; // sent as ranges
     int64_t timeout_us = 0;
     size_t packetIdx = SIZE_MAX;
     //uint32_t frontUnfinishedPacketId = UINT32_MAX;
@@ -284,6 +604,24 @@ public:
     uint8_t id = 0;
     bool isNew = true;
     bool isReliable = false;
+    // FEC: the SmallPackets received after the last parity, for the next one
+    struct FecPacket {
+        uint32_t id;
+        std::vector<uint8_t> data;
+    };
+    std::deque<FecPacket> fecPackets;
+    uint32_t fecNextPacketId = 0; // after the group of the last parity
+    bool isFec = false; // a parity was received
+
+    void addToFecGroup(const uint32_t packetId, const uint8_t* data, const uint32_t size_B) {
+        if (not isFec or packetId - fecNextPacketId >= UINT32_MAX / 2) {
+            return;
+        }
+        if (fecPackets.size() >= UINT8_MAX) {
+            fecPackets.pop_front(); // the parities are lost
+        }
+        fecPackets.push_back({ packetId, std::vector<uint8_t>(data, data + size_B) });
+    }
 
     void updateFrontPacketId(const bool isFront, const uint32_t packetId) {
         if (not fifoShadow.empty()) {
@@ -491,7 +829,9 @@ public:
     }
 };
 struct RxStreams {
-    std::deque<std::pair<uint8_t, uint32_t>> acks; // streamId, packetId
+    std::deque<uint8_t> ackStreams; // with RxStream::acks
+    uint32_t acksCount = 0; // pending
+    int64_t firstAck_us = 0; // of the pending ones
     std::unordered_map<uint8_t, RxStream> map;
     decltype(map)::iterator streamIt = map.end();
     bool isStreamsChanged = true;
@@ -507,11 +847,30 @@ struct RxStreams {
             }
         }
     }
+    void acknowledge(RxStream& stream, const uint32_t packetId, const int64_t now_us) {
+        if (ackStreams.empty()) {
+            firstAck_us = now_us;
+        }
+        if (stream.acks.empty()) {
+            ackStreams.push_back(stream.id);
+        }
+        else if (stream.acks.back() == packetId) {
+            return;
+        }
+        stream.acks.push_back(packetId);
+        ++acksCount;
+    }
+    bool isAckDue(const uint32_t ackEveryN, const uint32_t maxAckDelay_us,
+            const int64_t now_us) const {
+        return not ackStreams.empty()
+            and (acksCount >= ackEveryN or firstAck_us + maxAckDelay_us <= now_us);
+    }
 };
 
 struct UDSPSocket::Connection {
     Connection(UDSPSocket::Impl* impl_) : impl(impl_) {}
     UDSPSocket::Impl* impl = nullptr;
+    uint64_t key = 0; // in Impl::connections
 
     //uint64_t CCId = 0; // Client Connection Identificator
     //uint64_t SCId = 0; // Server Connection Identificator
@@ -555,6 +914,7 @@ struct UDSPSocket::Connection {
     uint32_t txPacketsLossSum_count = 0;
     //uint16_t txPacketsLossInWindow_prc100 = 0;
     uint16_t rxPacketsLossInWindow_prc100 = 0;
+    uint16_t rxPacketsLossSent_prc100 = 0; // in the last datagram
     float txPacketsLoss_prc = 0;
     float rxPacketsLoss_prc = 0;
 
@@ -562,6 +922,7 @@ struct UDSPSocket::Connection {
     uint8_t RTTCount = 0;
     uint8_t RTTRequest = 0;
     uint8_t RTTResponse = 0;
+    uint8_t RTTResponseSent = 0; // in the last datagram
     uint32_t RTT_us = 0;
     uint32_t minRTT_us = UINT32_MAX;
 
@@ -582,7 +943,9 @@ struct UDSPSocket::Connection {
     int64_t nextEraseTick_us = INT64_MAX;
 
     int64_t prevTick_us = 0;
+    int64_t nextDeparture_us = 0; // TX time pacing
     uint32_t txLimit_B_s = 0; // s_basePMTU_IPv4_B * s_packetsWindowSize * 8;
+    uint32_t summedTxLimit_B_s = 0; // in Impl::txLimitsSum_B_s
     uint32_t desiredTxLimit_B_s = (1 * 1000 * 1000 * 1000) / 8; // 1 Gbps
 
 # if UDSP_TRACE_LEVEL >= UDSP_TRACE_LEVEL_STATISTICS
@@ -595,12 +958,36 @@ struct UDSPSocket::Connection {
     bool tooBigRTT = false;
     bool isDisconnectRequested = false;
 
+    // The ack policy requested by the peer: an ack-only datagram is sent when
+    // ackEveryN reliable chunks are pending or the oldest is maxAckDelay_us old
+    uint8_t ackEveryN = 1;
+    uint32_t maxAckDelay_us = 0;
+    // The ack policy requested from the peer, repeated at 1 Hz
+    uint8_t peerAckEveryN = 1;
+    uint32_t peerMaxAckDelay_us = 0;
+    bool isAckFrequencyChanged = false;
+    bool isAckFrequencySet = false; // repeated also after a reset to the default
+    bool isTxInRxWindow = false; // any datagram since the RX window change
+    uint32_t getPeerAckDelay_us() const;
+    int64_t getRTO_us() const; // retransmission timeout
+
     void partialReset();
 
+    // Idle connections are not processed until a datagram, a command or a deadline
+    bool isActive = false;
+    std::atomic<bool> isNotified{ false }; // is in Impl::notifiedConnections
+    int64_t nextTimer_us = INT64_MAX; // in Impl::timers
+    bool isIdle(const bool isTestBandwidthEnabled) const;
+    int64_t getNextDeadline_us() const;
+
     std::function<void(
         uintptr_t context, Connection* connection, const void* data, uint64_t size_B,
         uint8_t txStreamId, char status
     )> onDelivered;
+    std::function<void(
+        uintptr_t context, Connection* connection, uint64_t readOffset_B,
+        uint32_t pieceSize_B, uint8_t* writeBuffer, uint8_t txStreamId
+    )> onSend;
     std::function<uintptr_t(
         uintptr_t context, Connection* connection, const void* data,
         uint64_t size_B, uint64_t offset_B, uint8_t rxStreamId, char status
@@ -609,13 +996,34 @@ struct UDSPSocket::Connection {
     std::vector<uint8_t> txBuffer;
     TxStreams txStreams;
     RxStreams rxStreams;
+    // Rare settings, under Impl::mutex
     std::deque<std::function<void()>> commands;
-    void doCommands() {
-        while (not commands.empty()) {
-            commands.front()(); //TODO: segfault
-            commands.pop_front();
-        }
-    }
+    // send, without the mutex: a record of 40 B in the queue, the owned data
+    // in txPayloads by the cell of the record, both reused by the I/O thread
+    struct TxCommand {
+        const void* pointer = nullptr; // nullptr - owned or pulled
+        uint64_t size_B = 0;
+        uintptr_t context = 0;
+        int64_t timeout_us = 0;
+        uint8_t streamId = 0;
+        bool isPulled = false;
+        bool hasPayload = false;
+    };
+    struct TxPayload {
+        std::vector<uint8_t> copy;
+        Buffer buffer;
+        std::vector<Segment> segments;
+    };
+    static constexpr uint32_t g_txCommandsSize = 256;
+    MPSCQueue<TxCommand, g_txCommandsSize> txCommands;
+    std::array<TxPayload, g_txCommandsSize> txPayloads;
+    // The sends after a full txCommands, until the I/O thread takes them, under Impl::mutex
+    std::deque<std::pair<TxCommand, TxPayload>> txSpill;
+    std::atomic<bool> isTxSpilled{ false };
+    std::atomic<uint32_t> txQuantum_B{ 256 }; // the last set, for getTxQuantum_B
+    void doCommands();
+    void doTxCommand(const TxCommand& command, TxPayload& payload);
+    TxStream& getTxStream(const uint8_t streamId);
 
     // Omax(log n)
     static size_t findPacketIdx(const std::deque<uint32_t>& fifo, const uint32_t packetId);
@@ -625,9 +1033,30 @@ struct UDSPSocket::Connection {
     void writeDisconnect();
 
     void nextDatagram();
-    uint32_t writeMetaChunk(const int64_t now_us, uint8_t* buffer, const uint32_t available_B);
-    // Omin(streams) Omax(packets)
+    uint32_t writeMetaChunk(const int64_t now_us, uint8_t* buffer, const uint32_t available_B,
+        const bool isAckAllowed = true);
+    // Amortized O(1) by the ready lists
     uint32_t writeDataChunk(const int64_t now_us, uint8_t* buffer, const uint32_t available_B);
+    // The packet of the front stream, or nullptr if none of them has one
+    TxPacket* findReadyPacket(std::deque<TxStream*>& ready, const int64_t now_us);
+    // The lost packets first, then the new ones
+    TxPacket* findNextPacket(TxStream& stream, const int64_t now_us);
+    // Moves the lost inflight packets to the retransmits, updates lossTime_us
+    void detectLosses(TxStream& stream, const int64_t now_us);
+    // Replaces stream and packet if another ready stream has an earlier deadline
+    void findEarliestPacket(const std::deque<TxStream*>& ready, const Priority priority,
+        const int64_t now_us, TxStream*& stream, TxPacket*& packet);
+    int64_t getDeliveryTime_us(const uint64_t size_B) const;
+    uint32_t writePacketChunk(const int64_t now_us, TxStream& stream, TxPacket& packet,
+        uint8_t* buffer, const uint32_t available_B);
+    // From the pointer, gathered from the segments or pulled by onSend
+    void writePacketData(const TxStream& stream, const TxPacket& packet,
+        const uint64_t offset_B, const uint32_t size_B, uint8_t*& buffer);
+    void onPacketSent(const int64_t now_us, TxStream& stream, TxPacket& packet);
+    // By the loss: a parity per K packets recovers one lost of them, 0 - without parity
+    uint8_t getFecGroupSize() const;
+    void addToFecGroup(const int64_t now_us, TxStream& stream, const TxPacket& packet,
+        const uint8_t* data);
     uint32_t writeChunk(const int64_t now_us, uint8_t* buffer, const uint32_t available_B);
     uint32_t readChunk(const int64_t now_us, const uint8_t* buffer, const uint32_t available_B);
 
@@ -645,6 +1074,12 @@ struct UDSPSocket::Impl {
     std::thread thread;
     mutable std::mutex mutex;
 
+    // Keys of the connections with new commands, filled by any thread
+    MPSCQueue<uint64_t, 1024> notifiedConnections;
+    std::atomic<bool> isNotifyOverflow{ false };
+    std::vector<Connection*> activeConnections;
+    TimerWheel timers;
+
     std::function<void(Connection* connection)> onConnected;
     std::function<void(Connection* connection, char reason)> onDisconnected;
 
@@ -652,12 +1087,22 @@ struct UDSPSocket::Impl {
 
     int64_t spent_us = 0;
     uint32_t TPS = 0;
+# if UDSP_TRACE_LEVEL >= UDSP_TRACE_LEVEL_STATISTICS
+    UDPSocket::BatchStatistics debugRxBatchStatistics;
+    UDPSocket::BatchStatistics debugTxBatchStatistics;
+# endif // UDSP_TRACE_LEVEL
 
     // NGTCP2_DEFAULT_MAX_RECV_UDP_PAYLOAD_SIZE
     uint16_t localPort = 0;
     bool isRunning = false;
     bool isServer = false;
     bool isTestBandwidthEnabled = false;
+    bool isTxTimePacingEnabled = false;
+    bool isMaxPacingRateEnabled = false;
+    bool isIoUringEnabled = false; // applied to the socket by the I/O thread
+    bool isDeadlineSchedulingEnabled = false;
+    uint32_t maxPacingRate_B_s = UINT32_MAX; // applied to the socket
+    uint64_t txLimitsSum_B_s = 0; // of the connected connections
 
     Impl();
     ~Impl();
@@ -672,15 +1117,40 @@ struct UDSPSocket::Impl {
     bool connect(const uint16_t port, const uint32_t IPv4);
     bool disconnect();
     bool isConnected();
-    bool listen(const uint16_t port);
+    // isShared - SO_REUSEPORT, for the workers of a sharded server
+    bool listen(const uint16_t port, const bool isShared);
+    void copySettings(const Impl& other);
 
+    // Under the mutex by Connection::commands, never dropped by a full send queue
     void setTxStreamPriority_ts(Connection* connection, uint8_t txStreamId, char priority);
+    void setTxStreamWeight_ts(Connection* connection, uint8_t txStreamId, uint32_t weight);
+    void setTxStreamFecState_ts(Connection* connection, uint8_t txStreamId, bool isEnabled);
+    void setTxQuantum_ts(Connection* connection, uint32_t quantum_B);
     //char getTxStreamPriority_ts(Connection* connection, uint8_t txStreamId) const;
     bool send_ts(uintptr_t context, Connection* connection, const void* data, uint64_t size_B,
         bool copy, uint8_t txStreamId, uint32_t timeout_ms, int64_t now_us);
+    bool send_ts(uintptr_t context, Connection* connection, std::vector<uint8_t>&& data,
+        uint8_t txStreamId, uint32_t timeout_ms, int64_t now_us);
+    bool send_ts(uintptr_t context, Connection* connection, Buffer&& data, uint64_t size_B,
+        uint8_t txStreamId, uint32_t timeout_ms, int64_t now_us);
+    bool send_ts(uintptr_t context, Connection* connection,
+        const std::vector<Segment>& segments, bool copy, uint8_t txStreamId, uint32_t timeout_ms, int64_t now_us);
+    bool send_ts(Connection* connection, Connection::TxCommand& command,
+        Connection::TxPayload& payload, int64_t now_us);
+    // Into the spill under the mutex if the queue is full, never fails
+    void push_ts(Connection& connection, const Connection::TxCommand& command,
+        Connection::TxPayload& payload);
+
+    void notify_ts(Connection& c);
+    void activate(Connection& c, const int64_t now_us);
+    void deactivate(const size_t activeIdx);
+    uint32_t getWaitTimeout_ms() const;
 
     void process();
     void process_ts();
+    // O(1), the limits of the processed connections are summed by updateTxLimitsSum
+    void updateMaxPacingRate();
+    void updateTxLimitsSum(Connection& c, const bool isErased = false);
     void processConnection(Connection& c, const int64_t now_us);
 
     void onUdpReceived(void* data, uint32_t size_B, uint16_t port, uint32_t IPv4);
@@ -0,0 +1,459 @@
+#include "IoUring.hpp"
+
+#if defined(__linux__)
+#   include <cassert>
+#   include <cerrno>
+#   include <cstring>
+#   include <csignal>
+#   include <unistd.h>
+#   include <poll.h>
+#   include <sys/mman.h>
+#   include <sys/syscall.h>
+#   include <sys/socket.h>
+#   include <netinet/in.h>
+#   include <linux/io_uring.h>
+#endif
+
+
+#if defined(__linux__)
+namespace {
+    constexpr uint64_t g_receiveTag = uint64_t(1) << 63;
+    constexpr uint64_t g_cancelTag = uint64_t(1) << 62;
+    constexpr uint64_t g_wakeupTag = uint64_t(1) << 61;
+    constexpr uint16_t g_bufferGroupId = 0;
+
+    int32_t io_uring_setup(const uint32_t entries, io_uring_params* params) {
+        return int32_t(::syscall(__NR_io_uring_setup, entries, params));
+    }
+    int32_t io_uring_enter(const int32_t ring, const uint32_t toSubmit,
+            const uint32_t minComplete, const uint32_t flags, const void* arg,
+            const size_t argSize_B) {
+        return int32_t(::syscall(__NR_io_uring_enter, ring, toSubmit, minComplete,
+            flags, arg, argSize_B));
+    }
+    int32_t io_uring_register(const int32_t ring, const uint32_t opcode, const void* arg,
+            const uint32_t argsCount) {
+        return int32_t(::syscall(__NR_io_uring_register, ring, opcode, arg, argsCount));
+    }
+
+    template <typename value_t>
+    value_t* at(void* base, const uint32_t offset_B) {
+        return reinterpret_cast<value_t*>(static_cast<char*>(base) + offset_B);
+    }
+} // namespace
+
+
+IoUring::~IoUring() {
+    close();
+}
+
+bool IoUring::init(const uint32_t entries, const uint32_t buffersCount,
+        const uint32_t bufferSize_B) {
+    close();
+    assert((buffersCount & (buffersCount - 1)) == 0);
+
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_CLAMP;
+    m_ring = io_uring_setup(entries, &params);
+    if (m_ring < 0) {
+        m_ring = -1;
+        return false;
+    }
+    m_features = params.features;
+    if (not (m_features & IORING_FEAT_SINGLE_MMAP) or not (m_features & IORING_FEAT_EXT_ARG)) {
+        close();
+        return false;
+    }
+
+    m_sqRingSize_B = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize_B = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (m_sqRingSize_B < m_cqRingSize_B) {
+        m_sqRingSize_B = m_cqRingSize_B;
+    }
+    m_sqRingPtr = ::mmap(nullptr, m_sqRingSize_B, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+    if (m_sqRingPtr == MAP_FAILED) {
+        m_sqRingPtr = nullptr;
+        close();
+        return false;
+    }
+    m_cqRingPtr = m_sqRingPtr; // IORING_FEAT_SINGLE_MMAP
+    m_cqRingSize_B = 0;
+    m_sqesSize_B = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqesPtr = ::mmap(nullptr, m_sqesSize_B, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+    if (m_sqesPtr == MAP_FAILED) {
+        m_sqesPtr = nullptr;
+        close();
+        return false;
+    }
+
+    m_sqHead = at<uint32_t>(m_sqRingPtr, params.sq_off.head);
+    m_sqTail = at<uint32_t>(m_sqRingPtr, params.sq_off.tail);
+    m_sqArray = at<uint32_t>(m_sqRingPtr, params.sq_off.array);
+    m_sqMask = *at<uint32_t>(m_sqRingPtr, params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+    m_sqLocalTail = *m_sqTail;
+    m_sqSubmitted = m_sqLocalTail;
+
+    m_cqHead = at<uint32_t>(m_cqRingPtr, params.cq_off.head);
+    m_cqTail = at<uint32_t>(m_cqRingPtr, params.cq_off.tail);
+    m_cqMask = *at<uint32_t>(m_cqRingPtr, params.cq_off.ring_mask);
+    m_cqes = at<io_uring_cqe>(m_cqRingPtr, params.cq_off.cqes);
+
+    // Provided buffer ring (Linux 5.19+), must be page-aligned
+    m_buffersCount = buffersCount;
+    m_bufferSize_B = bufferSize_B;
+    m_bufferRingSize_B = buffersCount * sizeof(io_uring_buf);
+    m_bufferRing = ::mmap(nullptr, m_bufferRingSize_B, PROT_READ | PROT_WRITE,
+        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (m_bufferRing == MAP_FAILED) {
+        m_bufferRing = nullptr;
+        close();
+        return false;
+    }
+    io_uring_buf_reg registration = {};
+    registration.ring_addr = reinterpret_cast<uint64_t>(m_bufferRing);
+    registration.ring_entries = buffersCount;
+    registration.bgid = g_bufferGroupId;
+    if (io_uring_register(m_ring, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        close();
+        return false;
+    }
+    m_buffers.resize(size_t(buffersCount) * bufferSize_B);
+    m_bufferRingTail = 0;
+    for (uint32_t bufferId = 0; bufferId < buffersCount; ++bufferId) {
+        recycle(bufferId);
+    }
+
+    m_receiveHeader.resize(sizeof(msghdr));
+    m_isFailed = false;
+    return true;
+}
+bool IoUring::isFailed() const {
+    return m_isFailed;
+}
+
+void IoUring::armReceive(const int32_t socket, const uint32_t controlSize_B) {
+    if (m_ring < 0) {
+        return;
+    }
+    if (m_isReceiveArmed) {
+        cancelReceive();
+    }
+    m_socket = socket;
+    m_controlSize_B = controlSize_B;
+    submitReceive();
+}
+void IoUring::submitReceive() {
+    auto& header = *reinterpret_cast<msghdr*>(m_receiveHeader.data());
+    header = {};
+    header.msg_namelen = sizeof(sockaddr_in);
+    header.msg_controllen = m_controlSize_B;
+
+    auto sqe = static_cast<io_uring_sqe*>(getSqe());
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = m_socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&header);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = g_bufferGroupId;
+    sqe->user_data = g_receiveTag;
+    m_isReceiveArmed = true;
+}
+void IoUring::cancelReceive() {
+    if (m_ring < 0 or not m_isReceiveArmed) {
+        return;
+    }
+    auto sqe = static_cast<io_uring_sqe*>(getSqe());
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = g_receiveTag;
+    sqe->user_data = g_cancelTag;
+    m_isCancelling = true;
+    // The last completion of the receive comes without IORING_CQE_F_MORE
+    for (uint32_t i = 0; i < 100 and (m_isReceiveArmed or m_isCancelling); ++i) {
+        if (not enter(1, 10)) {
+            break;
+        }
+        reap();
+    }
+    m_isCancelling = m_isReceiveArmed or m_isCancelling; // not completed in time
+    m_isReceiveArmed = false;
+    // Datagrams of the previous socket are dropped
+    for (const auto& it : m_received) {
+        if (it.flags & IORING_CQE_F_BUFFER) {
+            recycle(it.flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+    }
+    m_received.clear();
+}
+
+void IoUring::armWakeup(const int32_t fd) {
+    m_wakeup = fd;
+    if (m_ring >= 0 and not m_isWakeupArmed) {
+        submitWakeup();
+    }
+}
+void IoUring::submitWakeup() {
+    auto sqe = static_cast<io_uring_sqe*>(getSqe());
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = m_wakeup;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = g_wakeupTag;
+    m_isWakeupArmed = true;
+}
+
+void IoUring::send(const int32_t socket, msghdr* messages, int32_t* results,
+        const uint32_t count) {
+    if (m_ring < 0) {
+        for (uint32_t i = 0; i < count; ++i) {
+            results[i] = -EBADF;
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        auto sqe = static_cast<io_uring_sqe*>(getSqe());
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = socket;
+        sqe->addr = reinterpret_cast<uint64_t>(&messages[i]);
+        sqe->len = 1;
+        sqe->user_data = i;
+        results[i] = INT32_MIN; // in progress
+    }
+    // The messages live on the caller's stack, so wait for all of them.
+    // The completions are reaped into results also by enter() if the queue is full.
+    m_sendResults = results;
+    m_sendCount = count;
+    for (uint32_t pending = count; pending > 0;) {
+        if (not enter(pending, 0)) {
+            for (uint32_t i = 0; i < count; ++i) {
+                if (results[i] == INT32_MIN) {
+                    results[i] = -EIO;
+                }
+            }
+            break;
+        }
+        reap();
+        pending = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (results[i] == INT32_MIN) {
+                ++pending;
+            }
+        }
+    }
+    m_sendResults = nullptr;
+    m_sendCount = 0;
+}
+
+bool IoUring::process(const uint32_t timeout_ms, const OnReceived& onReceived) {
+    if (m_ring < 0) {
+        return false;
+    }
+    if (not m_isReceiveArmed and m_socket >= 0 and not m_isFailed) {
+        submitReceive();
+    }
+    if (not m_isWakeupArmed and m_wakeup >= 0) {
+        submitWakeup();
+    }
+    const bool isReady = not m_received.empty()
+        or __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) != *m_cqHead;
+    const bool isWaiting = not isReady and timeout_ms > 0;
+    if (not enter(isWaiting ? 1 : 0, isWaiting ? timeout_ms : 0)) {
+        return false;
+    }
+    reap();
+    const bool isWokenUp = m_isWokenUp;
+    m_isWokenUp = false;
+
+    // onReceived may send, which reaps more receives into m_received
+    while (not m_received.empty()) {
+        m_receivedSwap.clear();
+        m_receivedSwap.swap(m_received);
+        const auto& header = *reinterpret_cast<const msghdr*>(m_receiveHeader.data());
+        for (const auto& it : m_receivedSwap) {
+            if (not (it.flags & IORING_CQE_F_BUFFER)) {
+                continue;
+            }
+            const uint32_t bufferId = it.flags >> IORING_CQE_BUFFER_SHIFT;
+            char* buffer = &m_buffers[size_t(bufferId) * m_bufferSize_B];
+            const uint32_t headers_B = uint32_t(sizeof(io_uring_recvmsg_out))
+                + header.msg_namelen + uint32_t(header.msg_controllen);
+            if (it.result < 0 or uint32_t(it.result) < headers_B) {
+                recycle(bufferId);
+                continue;
+            }
+            const auto& out = *reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+            char* name = buffer + sizeof(io_uring_recvmsg_out);
+            char* control = name + header.msg_namelen;
+            char* payload = control + header.msg_controllen;
+            if ((out.flags & MSG_TRUNC) or out.namelen < sizeof(sockaddr_in)) {
+                recycle(bufferId);
+                continue;
+            }
+            sockaddr_in from = {};
+            std::memcpy(&from, name, sizeof(from));
+            msghdr datagramHeader = {};
+            datagramHeader.msg_control = control;
+            datagramHeader.msg_controllen = out.controllen;
+            onReceived(payload, out.payloadlen, from, datagramHeader);
+            recycle(bufferId);
+        }
+    }
+    if (not m_isReceiveArmed and m_socket >= 0 and not m_isFailed) {
+        submitReceive(); // submitted by the next enter
+    }
+    return isWokenUp;
+}
+
+void* IoUring::getSqe() {
+    const uint32_t head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqLocalTail - head >= m_sqEntries) {
+        enter(0, 0);
+    }
+    const uint32_t idx = m_sqLocalTail & m_sqMask;
+    auto sqe = &static_cast<io_uring_sqe*>(m_sqesPtr)[idx];
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    m_sqArray[idx] = idx;
+    ++m_sqLocalTail;
+    return sqe;
+}
+bool IoUring::enter(const uint32_t minComplete, const uint32_t timeout_ms) {
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+    const uint32_t toSubmit = m_sqLocalTail - m_sqSubmitted;
+    if (toSubmit == 0 and minComplete == 0) {
+        return true;
+    }
+    __kernel_timespec timeout = {};
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000 * 1000;
+    io_uring_getevents_arg arg = {};
+    arg.sigmask = 0;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = timeout_ms > 0 ? reinterpret_cast<uint64_t>(&timeout) : 0;
+
+    uint32_t flags = IORING_ENTER_EXT_ARG;
+    if (minComplete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    while (true) {
+        const int32_t submitted = io_uring_enter(m_ring, toSubmit, minComplete, flags,
+            &arg, sizeof(arg));
+        if (submitted >= 0) {
+            m_sqSubmitted += uint32_t(submitted);
+            return true;
+        }
+        switch (errno) {
+        case ETIME:
+            m_sqSubmitted = m_sqLocalTail;
+            return true;
+        case EINTR:
+            if (minComplete > 0 and timeout_ms > 0) {
+                m_sqSubmitted = m_sqLocalTail;
+                return true; // the SQEs were consumed before the wait
+            }
+            continue;
+        case EAGAIN:
+        case EBUSY:
+            reap(); // make room in the completion queue
+            continue;
+        default:
+            return false;
+        }
+    }
+}
+void IoUring::reap() {
+    uint32_t head = *m_cqHead;
+    const uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const auto& cqe = static_cast<const io_uring_cqe*>(m_cqes)[head & m_cqMask];
+        if (cqe.user_data == g_receiveTag) {
+            if (not (cqe.flags & IORING_CQE_F_MORE)) {
+                m_isReceiveArmed = false;
+                if (cqe.res == -EINVAL or cqe.res == -EOPNOTSUPP) {
+                    m_isFailed = true; // no multishot recvmsg (Linux < 6.0)
+                }
+            }
+            Completion completion;
+            completion.userData = cqe.user_data;
+            completion.result = cqe.res;
+            completion.flags = cqe.flags;
+            m_received.push_back(completion);
+        }
+        else if (cqe.user_data == g_wakeupTag) {
+            m_isWakeupArmed = false;
+            m_isWokenUp = true;
+        }
+        else if (cqe.user_data == g_cancelTag) {
+            m_isCancelling = false;
+        }
+        else if (cqe.user_data < m_sendCount) {
+            m_sendResults[cqe.user_data] = cqe.res;
+        }
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+void IoUring::recycle(const uint32_t bufferId) {
+    auto ring = static_cast<io_uring_buf*>(m_bufferRing);
+    auto& buffer = ring[m_bufferRingTail & (m_buffersCount - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(&m_buffers[size_t(bufferId) * m_bufferSize_B]);
+    buffer.len = m_bufferSize_B;
+    buffer.bid = uint16_t(bufferId);
+    ++m_bufferRingTail;
+    __atomic_store_n(&static_cast<io_uring_buf_ring*>(m_bufferRing)->tail,
+        m_bufferRingTail, __ATOMIC_RELEASE);
+}
+
+void IoUring::close() {
+    // The ring is torn down asynchronously, so the receive is cancelled before
+    // the buffers are freed
+    cancelReceive();
+    if (m_isCancelling) {
+        // Not completed in time, the kernel may still use them, so they are leaked
+        new std::vector<char>(std::move(m_buffers));
+        m_bufferRing = nullptr;
+        m_isCancelling = false;
+    }
+    if (m_ring >= 0) {
+        ::close(m_ring);
+        m_ring = -1;
+    }
+    if (m_bufferRing != nullptr) {
+        ::munmap(m_bufferRing, m_bufferRingSize_B);
+        m_bufferRing = nullptr;
+    }
+    if (m_sqesPtr != nullptr) {
+        ::munmap(m_sqesPtr, m_sqesSize_B);
+        m_sqesPtr = nullptr;
+    }
+    if (m_sqRingPtr != nullptr) {
+        ::munmap(m_sqRingPtr, m_sqRingSize_B);
+        m_sqRingPtr = nullptr;
+    }
+    m_cqRingPtr = nullptr;
+    m_buffers.clear();
+    m_received.clear();
+    m_socket = -1;
+    m_isWakeupArmed = false;
+    m_isWokenUp = false;
+}
+
+#else // __linux__
+
+IoUring::~IoUring() {}
+bool IoUring::init(const uint32_t, const uint32_t, const uint32_t) {
+    return false;
+}
+bool IoUring::isFailed() const {
+    return true;
+}
+void IoUring::armReceive(const int32_t, const uint32_t) {}
+void IoUring::cancelReceive() {}
+void IoUring::armWakeup(const int32_t) {}
+void IoUring::send(const int32_t, msghdr*, int32_t*, const uint32_t) {}
+bool IoUring::process(const uint32_t, const OnReceived&) {
+    return false;
+}
+
+#endif // __linux__
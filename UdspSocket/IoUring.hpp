@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct msghdr;
+struct sockaddr_in;
+
+// A minimal io_uring over raw syscalls (Linux 6.0+, no liburing):
+// multishot recvmsg into a provided buffer ring and batched sendmsg submissions.
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring& other) = delete;
+    ~IoUring();
+    IoUring& operator=(const IoUring& other) = delete;
+
+    // buffersCount - power of 2
+    bool init(const uint32_t entries, const uint32_t buffersCount, const uint32_t bufferSize_B);
+    // The multishot receive could be rejected by the kernel only after submission
+    bool isFailed() const;
+
+    // Stays armed until cancelled, re-armed by process() if the kernel stops it.
+    // controlSize_B - the space for ancillary data of each datagram.
+    void armReceive(const int32_t socket, const uint32_t controlSize_B);
+    void cancelReceive();
+    // A one-shot poll for POLLIN on fd, re-armed by process() after it fires
+    void armWakeup(const int32_t fd);
+
+    // Submits all messages at once and waits for their completions.
+    // results: sent bytes or -errno for each message
+    void send(const int32_t socket, msghdr* messages, int32_t* results, const uint32_t count);
+
+    // Waits for completions up to timeout_ms (0 - doesn't wait)
+    // and calls onReceived for each received datagram.
+    // Returns true if the wakeup descriptor became readable.
+    // header - only msg_control and msg_controllen are valid.
+    using OnReceived = std::function<void(
+        char* data, uint32_t size_B, const sockaddr_in& from, const msghdr& header
+    )>;
+    bool process(const uint32_t timeout_ms, const OnReceived& onReceived);
+
+private:
+    struct Completion {
+        uint64_t userData = 0;
+        int32_t result = 0;
+        uint32_t flags = 0;
+    };
+    void* getSqe();
+    // false - the ring is broken
+    bool enter(const uint32_t minComplete, const uint32_t timeout_ms);
+    // Sends results are stored by index into m_sendResults,
+    // receives are deferred into m_received
+    void reap();
+    void recycle(const uint32_t bufferId);
+    void submitReceive();
+    void submitWakeup();
+    void close();
+
+    int32_t m_ring = -1;
+    uint32_t m_features = 0;
+
+    void* m_sqRingPtr = nullptr;
+    size_t m_sqRingSize_B = 0;
+    void* m_cqRingPtr = nullptr;
+    size_t m_cqRingSize_B = 0;
+    void* m_sqesPtr = nullptr;
+    size_t m_sqesSize_B = 0;
+
+    uint32_t* m_sqHead = nullptr;
+    uint32_t* m_sqTail = nullptr;
+    uint32_t* m_sqArray = nullptr;
+    uint32_t m_sqMask = 0;
+    uint32_t m_sqEntries = 0;
+    uint32_t m_sqLocalTail = 0;
+    uint32_t m_sqSubmitted = 0;
+
+    uint32_t* m_cqHead = nullptr;
+    uint32_t* m_cqTail = nullptr;
+    uint32_t m_cqMask = 0;
+    void* m_cqes = nullptr;
+
+    void* m_bufferRing = nullptr;
+    size_t m_bufferRingSize_B = 0;
+    std::vector<char> m_buffers;
+    uint32_t m_buffersCount = 0;
+    uint32_t m_bufferSize_B = 0;
+    uint16_t m_bufferRingTail = 0;
+
+    std::vector<char> m_receiveHeader; // msghdr of the multishot receive
+    int32_t m_socket = -1;
+    uint32_t m_controlSize_B = 0;
+    bool m_isReceiveArmed = false;
+    bool m_isCancelling = false; // until the last completion of the receive
+    bool m_isFailed = false;
+    int32_t m_wakeup = -1;
+    bool m_isWakeupArmed = false;
+    bool m_isWokenUp = false;
+    int32_t* m_sendResults = nullptr; // of the send in progress
+    uint32_t m_sendCount = 0;
+    std::vector<Completion> m_received;
+    std::vector<Completion> m_receivedSwap;
+};
@@ -4,8 +4,17 @@ namespace {
     constexpr int64_t g_resetTxCountersPeriod_us = 10 * 1000 * 1000;
     //constexpr uint8_t g_maxInflightPacketsPerTxStream = 10;
     constexpr uint32_t g_chunkHeader_B = 1 + 1 + 4;
-    constexpr uint32_t g_txFifoReturnK = 2; // RTT * K
+    constexpr uint32_t g_ackRangesHeader_B = g_chunkHeader_B + 1;
+    constexpr uint32_t g_ackRange_B = 2 + 2;
+    constexpr uint32_t g_RTOK = 2; // RTT * K
+    constexpr int64_t g_minRTO_us = 1000;
+    constexpr uint32_t g_maxAckDelay_us = 250 * 1000;
     constexpr uint32_t g_rxFifoCleanupK = 200; // RTT * K
+    constexpr uint32_t g_fecMaxPacketSize_B = 1024; // the parity fits any datagram
+    constexpr uint8_t g_fecMaxGroupSize = 16;
+    constexpr float g_fecMinLoss_prc = 0.5f;
+    constexpr float g_fecLossK = 25.0f; // the group size = K / loss_prc
+    constexpr int64_t g_fecMinGroupTime_us = 2000;
 
     template <typename value_t>
     void write_u8(uint8_t*& buffer, const value_t value) {
@@ -57,6 +66,24 @@ namespace {
         buffer += sizeof(uint64_t);
         return value;
     }
+
+    void write_bits(uint8_t*& buffer, const ChunkId::Bits bits, const uint64_t value) {
+        switch (bits) {
+        case ChunkId::Bits::u8:     write_u8(buffer, value);    break;
+        case ChunkId::Bits::u16:    write_u16(buffer, value);   break;
+        case ChunkId::Bits::u32:    write_u32(buffer, value);   break;
+        case ChunkId::Bits::u64:    write_u64(buffer, value);   break;
+        }
+    }
+    uint64_t read_bits(const uint8_t*& buffer, const ChunkId::Bits bits) {
+        switch (bits) {
+        case ChunkId::Bits::u8:     return read_u8(buffer);
+        case ChunkId::Bits::u16:    return read_u16(buffer);
+        case ChunkId::Bits::u32:    return read_u32(buffer);
+        case ChunkId::Bits::u64:    return read_u64(buffer);
+        }
+        return 0;
+    }
 } // namespace
 
 void UDSPSocket::Impl::setTxStreamPriority_ts(Connection* c, uint8_t txStreamId, char priority) {
@@ -78,15 +105,10 @@ void UDSPSocket::Impl::setTxStreamPriority_ts(Connection* c, uint8_t txStreamId,
         assert(false and priority);
         return;
     }
+    const bool isReliable = priority < 'a';
     std::lock_guard<std::mutex> lock(mutex);
-    c->commands.emplace_back([=] {
-        auto& stream = c->txStreams.map[txStreamId];
-        if (stream.isNew) {
-            stream.isNew = false;
-            stream.id = txStreamId;
-            c->txStreams.isStreamsChanged = true;
-        }
-        const bool isReliable = priority < 'a';
+    c->commands.emplace_back([c, txStreamId, newPriority, isReliable] {
+        auto& stream = c->getTxStream(txStreamId);
         if (stream.priority == newPriority and stream.isReliable == isReliable) {
             return;
         }
@@ -94,6 +116,31 @@ void UDSPSocket::Impl::setTxStreamPriority_ts(Connection* c, uint8_t txStreamId,
         stream.isReliable = isReliable;
         c->txStreams.isStreamsChanged = true;
     });
+    notify_ts(*c);
+}
+void UDSPSocket::Impl::setTxStreamWeight_ts(Connection* c, uint8_t txStreamId, uint32_t weight) {
+    std::lock_guard<std::mutex> lock(mutex);
+    c->commands.emplace_back([c, txStreamId, weight] {
+        c->getTxStream(txStreamId).weight = weight;
+    });
+    notify_ts(*c);
+}
+void UDSPSocket::Impl::setTxStreamFecState_ts(Connection* c, uint8_t txStreamId, bool isEnabled) {
+    std::lock_guard<std::mutex> lock(mutex);
+    c->commands.emplace_back([c, txStreamId, isEnabled] {
+        auto& stream = c->getTxStream(txStreamId);
+        stream.isFecEnabled = isEnabled;
+        stream.isFecClosed = true; // if there is an open group
+    });
+    notify_ts(*c);
+}
+void UDSPSocket::Impl::setTxQuantum_ts(Connection* c, uint32_t quantum_B) {
+    std::lock_guard<std::mutex> lock(mutex);
+    c->commands.emplace_back([c, quantum_B] {
+        c->txStreams.quantum_B = quantum_B;
+    });
+    c->txQuantum_B = quantum_B;
+    notify_ts(*c);
 }
 //char UDSPSocket::Impl::getTxStreamPriority_ts(Connection& c, uint8_t txStreamId) const {
 //    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
@@ -122,53 +169,191 @@ void UDSPSocket::Impl::setTxStreamPriority_ts(Connection* c, uint8_t txStreamId,
 
 bool UDSPSocket::Impl::send_ts(uintptr_t context, Connection* c, const void* data,
         uint64_t size_B, bool copy, uint8_t streamId, uint32_t timeout_ms, int64_t now_us) {
-    if (c == nullptr) {
+    Connection::TxCommand command;
+    Connection::TxPayload payload;
+    if (data == nullptr) {
+        command.isPulled = true;
+    }
+    else if (copy) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        payload.copy.assign(bytes, bytes + size_B);
+        command.hasPayload = true;
+    }
+    else {
+        command.pointer = data;
+    }
+    command.size_B = size_B;
+    command.context = context;
+    command.streamId = streamId;
+    command.timeout_us = now_us + int64_t(timeout_ms) * 1000;
+    return send_ts(c, command, payload, now_us);
+}
+bool UDSPSocket::Impl::send_ts(uintptr_t context, Connection* c, std::vector<uint8_t>&& data,
+        uint8_t streamId, uint32_t timeout_ms, int64_t now_us) {
+    Connection::TxCommand command;
+    Connection::TxPayload payload;
+    command.size_B = data.size();
+    command.context = context;
+    command.streamId = streamId;
+    command.timeout_us = now_us + int64_t(timeout_ms) * 1000;
+    command.hasPayload = true;
+    payload.copy = std::move(data);
+    if (not send_ts(c, command, payload, now_us)) {
+        data = std::move(payload.copy);
         return false;
     }
-    if (data == nullptr or size_B == 0) {
+    return true;
+}
+bool UDSPSocket::Impl::send_ts(uintptr_t context, Connection* c, Buffer&& data,
+        uint64_t size_B, uint8_t streamId, uint32_t timeout_ms, int64_t now_us) {
+    if (data == nullptr) {
         return false;
     }
-    if (timeout_ms < 10) {
+    Connection::TxCommand command;
+    Connection::TxPayload payload;
+    command.pointer = data.get();
+    command.size_B = size_B;
+    command.context = context;
+    command.streamId = streamId;
+    command.timeout_us = now_us + int64_t(timeout_ms) * 1000;
+    command.hasPayload = true;
+    payload.buffer = std::move(data);
+    if (not send_ts(c, command, payload, now_us)) {
+        data = std::move(payload.buffer);
         return false;
     }
-
-    std::vector<uint8_t> bufferA;
+    return true;
+}
+bool UDSPSocket::Impl::send_ts(uintptr_t context, Connection* c,
+        const std::vector<Segment>& segments, bool copy, uint8_t streamId,
+        uint32_t timeout_ms, int64_t now_us) {
+    Connection::TxCommand command;
+    Connection::TxPayload payload;
+    for (const auto& segment : segments) {
+        if (segment.data == nullptr and segment.size_B != 0) {
+            return false;
+        }
+        command.size_B += segment.size_B;
+    }
     if (copy) {
-        auto bytes = static_cast<const uint8_t*>(data);
-        bufferA.insert(bufferA.end(), bytes, bytes + size_B);
+        payload.copy.reserve(command.size_B);
+        for (const auto& segment : segments) {
+            auto bytes = static_cast<const uint8_t*>(segment.data);
+            payload.copy.insert(payload.copy.end(), bytes, bytes + segment.size_B);
+        }
     }
+    else {
+        payload.segments = segments;
+    }
+    command.context = context;
+    command.streamId = streamId;
+    command.timeout_us = now_us + int64_t(timeout_ms) * 1000;
+    command.hasPayload = true;
+    return send_ts(c, command, payload, now_us);
+}
+bool UDSPSocket::Impl::send_ts(Connection* c, Connection::TxCommand& command,
+        Connection::TxPayload& payload, int64_t now_us) {
+    if (c == nullptr) {
+        return false;
+    }
+    if (command.size_B == 0) {
+        return false;
+    }
+    if (command.timeout_us - now_us < 10 * 1000) {
+        return false;
+    }
+    push_ts(*c, command, payload);
+    return true;
+}
+void UDSPSocket::Impl::push_ts(Connection& c, const Connection::TxCommand& command,
+        Connection::TxPayload& payload) {
+    const auto write = [&c, &command, &payload](Connection::TxCommand& cell,
+            const uint32_t cellIdx) {
+        cell = command;
+        if (command.hasPayload) {
+            c.txPayloads[cellIdx] = std::move(payload);
+        }
+    };
+    // Once spilled, the next sends follow it to keep the order
+    if (c.isTxSpilled or not c.txCommands.pushWith(write)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        c.txSpill.emplace_back(command, std::move(payload));
+        c.isTxSpilled = true;
+    }
+    notify_ts(c); // instead of waiting for the poll timeout
+}
 
-    std::lock_guard<std::mutex> lock(mutex);
-    c->commands.emplace_back([=, bufferB = std::move(bufferA)] {
-        auto& stream = c->txStreams.map[streamId];
-        if (stream.isNew) {
-            stream.isNew = false;
-            stream.id = streamId;
-            c->txStreams.isStreamsChanged = true;
+void UDSPSocket::Connection::doCommands() {
+    while (not commands.empty()) {
+        commands.front()(); //TODO: segfault
+        commands.pop_front();
+    }
+    TxCommand command;
+    TxPayload payload;
+    const auto read = [this, &command, &payload](TxCommand& cell, const uint32_t cellIdx) {
+        command = cell;
+        if (cell.hasPayload) {
+            payload = std::move(txPayloads[cellIdx]);
+        }
+    };
+    while (txCommands.popWith(read)) {
+        doTxCommand(command, payload);
+    }
+    // Under Impl::mutex, so the spill is after all of the queued sends when the queue is empty
+    if (isTxSpilled and txCommands.isEmpty()) {
+        for (auto& spilled : txSpill) {
+            doTxCommand(spilled.first, spilled.second);
         }
-        auto& fifo = stream.fifo;
-        //if (fifo.size() >= 1000000) {
-        //    assert(fifo.size() < 1000000);
-        //    return false;
-        //}
-        fifo.emplace_back();
-        auto& packet = fifo.back();
-        if (copy) {
-            packet.copy = std::move(bufferB);
-            packet.pointer = packet.copy.data();
+        txSpill.clear();
+        isTxSpilled = false;
+    }
+}
+TxStream& UDSPSocket::Connection::getTxStream(const uint8_t streamId) {
+    auto& stream = txStreams.map[streamId];
+    if (stream.isNew) {
+        stream.isNew = false;
+        stream.id = streamId;
+        txStreams.isStreamsChanged = true;
+    }
+    return stream;
+}
+void UDSPSocket::Connection::doTxCommand(const TxCommand& command, TxPayload& payload) {
+    auto& stream = getTxStream(command.streamId);
+    auto& fifo = stream.fifo;
+    //if (fifo.size() >= 1000000) {
+    //    assert(fifo.size() < 1000000);
+    //    return false;
+    //}
+    if (command.isPulled and onSend == nullptr) {
+        if (onDelivered) {
+            onDelivered(command.context, this, nullptr, command.size_B, stream.id, 't');
         }
-        else {
-            packet.pointer = static_cast<const uint8_t*>(data);
-        }
-        packet.size_B = size_B;
-        packet.timeout_us = now_us + int64_t(timeout_ms) * 1000;
-        packet.id = stream.nextPacketId++;
-        //std::cout << "Debug: Enqueue packetId=" << packet.id << "\n";
-        packet.isReliable = stream.isReliable;
-        packet.context = context;
-        stream.fifoShadow.emplace_back(packet.id);
-    });
-    return true;
+        return;
+    }
+    fifo.emplace_back();
+    auto& packet = fifo.back();
+    if (command.isPulled) {
+        packet.isPulled = true;
+    }
+    else if (not payload.segments.empty()) {
+        packet.segments = std::move(payload.segments);
+    }
+    else if (command.pointer == nullptr) {
+        packet.copy = std::move(payload.copy);
+        packet.pointer = packet.copy.data();
+    }
+    else {
+        packet.pointer = static_cast<const uint8_t*>(command.pointer);
+        packet.buffer = std::move(payload.buffer);
+    }
+    packet.size_B = command.size_B;
+    packet.timeout_us = command.timeout_us;
+    packet.id = stream.nextPacketId++;
+    //std::cout << "Debug: Enqueue packetId=" << packet.id << "\n";
+    packet.isReliable = stream.isReliable;
+    packet.context = command.context;
+    stream.fifoShadow.emplace_back(packet.id);
+    txStreams.setReady(stream);
 }
 
 void UDSPSocket::Connection::nextDatagram() {
@@ -178,22 +363,133 @@ void UDSPSocket::Connection::nextDatagram() {
     //txStreams.countMediumInDatagram = 0;
     //txStreams.countLowInDatagram = 0;
 }
+uint32_t UDSPSocket::Connection::getPeerAckDelay_us() const {
+    return std::min(peerMaxAckDelay_us, g_maxAckDelay_us);
+}
+int64_t UDSPSocket::Connection::getRTO_us() const {
+    return std::max(g_minRTO_us, int64_t(RTT_us) * g_RTOK + getPeerAckDelay_us());
+}
+
 uint32_t UDSPSocket::Connection::writeMetaChunk(const int64_t now_us,
-        uint8_t* buffer, const uint32_t available_B) {
-    if (not rxStreams.acks.empty()) {
-        const uint32_t chunkSize_B = g_chunkHeader_B;
+        uint8_t* buffer, const uint32_t available_B, const bool isAckAllowed) {
+    if (isAckFrequencyChanged and g_chunkHeader_B <= available_B) {
+        isAckFrequencyChanged = false;
+        ChunkId chunkId;
+        chunkId.smallPacket.chunkType = ChunkId::Type::SmallPacket;
+        chunkId.smallPacket.isAcknowledge = true;
+        write_u8(buffer, chunkId.total);
+        write_u8(buffer, peerAckEveryN);
+        write_u32(buffer, getPeerAckDelay_us());
+        return g_chunkHeader_B;
+    }
+    for (size_t i = 0; i < txStreams.fecStreams.size(); ++i) {
+        auto streamIt = txStreams.map.find(txStreams.fecStreams[i]);
+        if (streamIt == txStreams.map.end() or streamIt->second.fecCount == 0) {
+            txStreams.fecStreams.erase(txStreams.fecStreams.begin() + i--);
+            continue;
+        }
+        auto& stream = streamIt->second;
+        if (stream.fecDeadline_us <= now_us) {
+            stream.isFecClosed = true;
+        }
+        // Not lost together with the last packet of the group
+        if (not stream.isFecClosed or stream.fecDatagramId == txPacketsCount) {
+            continue;
+        }
+        const uint32_t paritySize_B = uint32_t(stream.fecParity.size());
+        ChunkId chunkId;
+        chunkId.smallPacket.chunkType = ChunkId::Type::SmallPacket;
+        chunkId.smallPacket.isRanges = true;
+        chunkId.smallPacket.isAcknowledge = true;
+        chunkId.smallPacket.packetSizeBits = ChunkId::getNumberOfBits(
+            std::max<uint64_t>(paritySize_B, stream.fecSizesXor));
+        const uint32_t sizeBytes_B = ChunkId::getNumberOfBytes(
+            chunkId.smallPacket.packetSizeBits);
+        const uint32_t chunkSize_B = g_chunkHeader_B + 1 + sizeBytes_B * 2 + paritySize_B;
         if (chunkSize_B > available_B) {
+            continue; // the acks and repeats may still fit
+        }
+        write_u8(buffer, chunkId.total);
+        write_u8(buffer, stream.id);
+        write_u32(buffer, stream.fecFirstPacketId);
+        write_u8(buffer, stream.fecCount);
+        write_bits(buffer, chunkId.smallPacket.packetSizeBits, paritySize_B);
+        write_bits(buffer, chunkId.smallPacket.packetSizeBits, stream.fecSizesXor);
+        write_data(buffer, stream.fecParity.data(), paritySize_B);
+
+        // The group is sent
+        for (uint32_t id = 0; id < stream.fecCount; ++id) {
+            TxPacket* packet = stream.findPacket(stream.fecFirstPacketId + id);
+            if (packet != nullptr) {
+                packet->isAcknowledged = true;
+            }
+        }
+        stream.fecCount = 0;
+        stream.isFecClosed = false;
+        txStreams.fecStreams.erase(txStreams.fecStreams.begin() + i);
+        processTxFifo(stream, now_us);
+        return chunkSize_B;
+    }
+    while (isAckAllowed and not rxStreams.ackStreams.empty()) {
+        auto streamIt = rxStreams.map.find(rxStreams.ackStreams.front());
+        if (streamIt == rxStreams.map.end() or streamIt->second.acks.empty()) {
+            rxStreams.ackStreams.pop_front();
+            continue;
+        }
+        auto& stream = streamIt->second;
+        if (g_ackRangesHeader_B + g_ackRange_B > available_B) {
             return 0;
         }
+        auto& acks = stream.acks;
+        const uint32_t firstId = acks.front();
+        std::sort(acks.begin(), acks.end(), [firstId](const uint32_t a, const uint32_t b) {
+            return int32_t(a - firstId) < int32_t(b - firstId); // UINT32_MAX < 0
+        });
+        acks.erase(std::unique(acks.begin(), acks.end()), acks.end());
+
         ChunkId chunkId;
         chunkId.smallPacket.chunkType = ChunkId::Type::SmallPacket;
+        chunkId.smallPacket.isRanges = true;
         chunkId.smallPacket.isAcknowledge = true;
         chunkId.smallPacket.isReliable = true;
         write_u8(buffer, chunkId.total);
-        write_u8(buffer, rxStreams.acks.front().first);
-        write_u32(buffer, rxStreams.acks.front().second);
-        rxStreams.acks.pop_front();
-        return chunkSize_B;
+        write_u8(buffer, stream.id);
+        write_u32(buffer, acks.front());
+        uint8_t* count = buffer;
+        write_u8(buffer, 0);
+
+        const uint32_t maxCount = std::min<uint32_t>(
+            UINT8_MAX, (available_B - g_ackRangesHeader_B) / g_ackRange_B
+        );
+        uint32_t rangeEnd = acks.front();
+        size_t ackIdx = 0;
+        while (ackIdx < acks.size() and *count < maxCount) {
+            const uint32_t gap = acks[ackIdx] - rangeEnd;
+            if (gap > UINT16_MAX) {
+                break; // in the next chunk
+            }
+            uint32_t length = 1;
+            while (ackIdx + length < acks.size() and length < UINT16_MAX
+                    and acks[ackIdx + length] == acks[ackIdx] + length) {
+                ++length;
+            }
+            write_u16(buffer, gap);
+            write_u16(buffer, length);
+            rangeEnd = acks[ackIdx] + length;
+            ackIdx += length;
+            ++*count;
+        }
+        acks.erase(acks.begin(), acks.begin() + ackIdx);
+        if (acks.empty()) {
+            rxStreams.ackStreams.pop_front();
+        }
+        if (rxStreams.ackStreams.empty()) {
+            rxStreams.acksCount = 0;
+        }
+        else {
+            rxStreams.acksCount -= std::min<uint32_t>(rxStreams.acksCount, uint32_t(ackIdx));
+        }
+        return g_ackRangesHeader_B + *count * g_ackRange_B;
     }
     for (uint32_t i1 = 0, s1 = uint32_t(rxStreams.map.size()); i1 < s1; ++i1) {
         rxStreams.next();
@@ -205,41 +501,76 @@ uint32_t UDSPSocket::Connection::writeMetaChunk(const int64_t now_us,
             if (packet.datagramId == txPacketsCount) {
                 break;
             }
+            if (packet.size_B == 0 and packet.repeat_us != 0
+                    and packet.repeat_us + RTT_us * 2 <= now_us) {
+                packet.repeat_us = now_us; // BeginOfPacket is lost
+                packet.offsetRepeat_B = 0;
+            }
+            if (packet.isGapsChanged and packet.ranges.empty()) {
+                packet.isGapsChanged = false; // already filled
+            }
+            if (packet.needToSendRepeatInfo() and packet.offsetRepeat_B == UINT64_MAX) {
+                // The gaps before the ranges received out of order
+                uint64_t maxOffset_B = 0;
+                uint64_t maxSize_B = 0;
+                uint64_t gapBegin_B = packet.offset_B;
+                for (const auto& range : packet.ranges) {
+                    maxOffset_B = std::max(maxOffset_B, gapBegin_B);
+                    maxSize_B = std::max(maxSize_B, range.first - gapBegin_B);
+                    gapBegin_B = range.second;
+                }
+                ChunkId chunkId;
+                chunkId.repeatInfo.chunkType = ChunkId::Type::RepeatInfo;
+                chunkId.repeatInfo.isRanges = true;
+                chunkId.repeatInfo.repeatOffsetBits = ChunkId::getNumberOfBits(maxOffset_B);
+                chunkId.repeatInfo.repeatSizeBits = ChunkId::getNumberOfBits(maxSize_B);
+                const uint32_t range_B
+                    = ChunkId::getNumberOfBytes(chunkId.repeatInfo.repeatOffsetBits)
+                    + ChunkId::getNumberOfBytes(chunkId.repeatInfo.repeatSizeBits);
+                if (g_chunkHeader_B + 1 + range_B > available_B) {
+                    return 0;
+                }
+                const uint32_t count = std::min<uint32_t>({
+                    UINT8_MAX, uint32_t(packet.ranges.size()),
+                    (available_B - g_chunkHeader_B - 1) / range_B
+                });
+                write_u8(buffer, chunkId.total);
+                write_u8(buffer, stream.id);
+                write_u32(buffer, packet.id);
+                write_u8(buffer, count);
+                gapBegin_B = packet.offset_B;
+                for (uint32_t i = 0; i < count; ++i) {
+                    write_bits(buffer, chunkId.repeatInfo.repeatOffsetBits, gapBegin_B);
+                    write_bits(buffer, chunkId.repeatInfo.repeatSizeBits,
+                        packet.ranges[i].first - gapBegin_B);
+                    gapBegin_B = packet.ranges[i].second;
+                }
+                packet.isGapsChanged = false;
+                packet.datagramId = txPacketsCount;
+                return g_chunkHeader_B + 1 + count * range_B;
+            }
             if (packet.needToSendRepeatInfo()) {
+                // From the offset to the end
                 ChunkId chunkId;
                 chunkId.repeatInfo.chunkType = ChunkId::Type::RepeatInfo;
                 chunkId.repeatInfo.repeatOffsetBits
                     = ChunkId::getNumberOfBits(packet.offsetRepeat_B);
-                chunkId.repeatInfo.repeatSizeBits
-                    = ChunkId::getNumberOfBits(packet.sizeRepeat_B);
+                chunkId.repeatInfo.repeatSizeBits = ChunkId::Bits::u8;
 
                 const uint32_t repeatOffsetBytes_B
                     = ChunkId::getNumberOfBytes(chunkId.repeatInfo.repeatOffsetBits);
-                const uint32_t repeatSizeBytes_B
-                    = ChunkId::getNumberOfBytes(chunkId.repeatInfo.repeatSizeBits);
-                const uint32_t chunkSize_B = g_chunkHeader_B + repeatOffsetBytes_B + repeatSizeBytes_B;
+                const uint32_t chunkSize_B = g_chunkHeader_B + repeatOffsetBytes_B + 1;
                 if (chunkSize_B > available_B) {
                     return 0;
                 }
                 write_u8(buffer, chunkId.total);
                 write_u8(buffer, stream.id);
                 write_u32(buffer, packet.id);
-                switch (ChunkId::Bits(chunkId.repeatInfo.repeatOffsetBits)) { // GCC 4.9
-                case ChunkId::Bits::u8:     write_u8(buffer, packet.offsetRepeat_B);    break;
-                case ChunkId::Bits::u16:    write_u16(buffer, packet.offsetRepeat_B);   break;
-                case ChunkId::Bits::u32:    write_u32(buffer, packet.offsetRepeat_B);   break;
-                case ChunkId::Bits::u64:    write_u64(buffer, packet.offsetRepeat_B);   break;
-                default:                                                                return 0;
-                }
-                switch (ChunkId::Bits(chunkId.repeatInfo.repeatSizeBits)) { // GCC 4.9
-                case ChunkId::Bits::u8:     write_u8(buffer, packet.sizeRepeat_B);  break;
-                case ChunkId::Bits::u16:    write_u16(buffer, packet.sizeRepeat_B); break;
-                case ChunkId::Bits::u32:    write_u32(buffer, packet.sizeRepeat_B); break;
-                case ChunkId::Bits::u64:    write_u64(buffer, packet.sizeRepeat_B); break;
-                default:                                                            return 0;
-                }
+                write_bits(buffer, chunkId.repeatInfo.repeatOffsetBits, packet.offsetRepeat_B);
+                write_u8(buffer, 0);
 
                 packet.offsetRepeat_B = UINT64_MAX;
+                packet.isGapsChanged = false;
                 packet.datagramId = txPacketsCount;
                 //std::cout << now_us / 1000 << " Debug: TX RepeatInfo streamId="
                 //    << rxStreams.streamIt->first
@@ -256,210 +587,205 @@ uint32_t UDSPSocket::Connection::writeDataChunk(const int64_t now_us,
         return 0;
     }
 
-    // Selecting the next chunk of the next packet of the next stream based on priority.
-    // As a result - information about the next packet for each priority.
+    // Selecting the next chunk of the next packet of the next stream:
+    // realtime first (up to 98 %), then the others by deficit round-robin.
 
     txStreams.update();
 
-    std::array<TxStream*, size_t(Priority::_count_)> streamByPriority = {};
-    std::array<TxPacket*, size_t(Priority::_count_)> packetByPriority = {};
-
-    for (uint8_t iPriority = 0; iPriority < uint8_t(Priority::_count_); ++iPriority) {
-        auto& priorityMeta = txStreams.vec[iPriority];
-
-        for (size_t iPrVec = 0, vecIdx = priorityMeta.vecIdx;
-                iPrVec < priorityMeta.vec.size(); ++iPrVec) {
-            if (vecIdx >= priorityMeta.vec.size()) {
-                vecIdx = 0;
-            }
-            TxStream& stream = *priorityMeta.vec[vecIdx++];
-            processTxFifo(stream, now_us);
+    // Detecting losses of the exhausted streams with unacknowledged packets
+    while (not txStreams.lossTimers.empty() and txStreams.lossTimers.top().first <= now_us) {
+        const auto timer = txStreams.lossTimers.top();
+        txStreams.lossTimers.pop();
+        auto streamIt = txStreams.map.find(timer.second);
+        if (streamIt == txStreams.map.end()) {
+            continue;
+        }
+        TxStream& stream = streamIt->second;
+        if (stream.isReady or stream.lossTimer_us != timer.first) {
+            continue; // outdated
+        }
+        processTxFifo(stream, now_us); // ready if there are lost packets
+        if (not stream.isReady and stream.lossTime_us != INT64_MAX) {
+            stream.lossTimer_us = stream.lossTime_us;
+            txStreams.lossTimers.emplace(stream.lossTimer_us, stream.id);
+        }
+    }
 
-            std::deque<TxPacket>& fifo = stream.fifo;
-            for (size_t iPacket = 0; iPacket < fifo.size(); ++iPacket) {
-                if (stream.fifoReturnTime_us + RTT_us * g_txFifoReturnK < now_us) {
-                    stream.fifoReturnTime_us = now_us + RTT_us * g_txFifoReturnK;
-                    stream.packetFifoIdx = 0;
-                }
-                // To limit RX queue in the receiver side
-                //if (stream.packetFifoIdx > UINT16_MAX / 2) {
-                if (stream.packetFifoIdx > 1 << 17) {
-                    break;
-                }
-                if (stream.packetFifoIdx >= fifo.size()) {
-                    break;
-                }
-                TxPacket& packet = fifo[stream.packetFifoIdx];
-                if (packet.isAcknowledged) {
-                    ++stream.packetFifoIdx;
-                    continue;
-                }
-                // Timed out, waiting for pop_front
-                if (packet.timeout_us <= now_us) {
-                    ++stream.packetFifoIdx;
-                    continue;
-                }
-                // To prevent sending the same small packet through the same datagram
-                if (packet.datagramId == txPacketsCount) {
-                    ++stream.packetFifoIdx;
-                    continue;
-                }
-                // To prevent sending the same small packet too frequently
-                if (not packet.isStarted and now_us < packet.begin_us + RTT_us * 2) {
-                    ++stream.packetFifoIdx;
-                    continue; //TODO: Check
-                }
-                streamByPriority[iPriority] = &stream;
-                packetByPriority[iPriority] = &packet;
-                break;
-            }
-#         if UDSP_TRACE_LEVEL >= UDSP_TRACE_LEVEL_STATISTICS
-            debugMaxTxQueue = std::max(debugMaxTxQueue, uint32_t(stream.packetFifoIdx));
-#         endif // UDSP_TRACE_LEVEL
-            if (packetByPriority[iPriority] != nullptr) {
-                break;
-            }
+    TxPacket* realtimePacket = findReadyPacket(txStreams.realtime, now_us);
+    TxPacket* weightedPacket = nullptr;
+    while (true) {
+        weightedPacket = findReadyPacket(txStreams.weighted, now_us);
+        if (weightedPacket == nullptr) {
+            break;
+        }
+        TxStream& stream = *txStreams.weighted.front();
+        if (stream.deficit_B > 0) {
+            break;
         }
+        // The next round of this stream
+        stream.deficit_B += int64_t(txStreams.quantum_B) * stream.getWeight();
+        if (stream.deficit_B > 0) {
+            break;
+        }
+        txStreams.weighted.pop_front();
+        txStreams.weighted.push_back(&stream);
     }
 
     const uint32_t countSentRealtime_B = txStreams.vec[size_t(Priority::Realtime)].countSent_B;
-    const uint32_t countSentHigh_B = txStreams.vec[size_t(Priority::High)].countSent_B;
-    const uint32_t countSentMedium_B = txStreams.vec[size_t(Priority::Medium)].countSent_B;
-    const uint32_t countSentLow_B = txStreams.vec[size_t(Priority::Low)].countSent_B;
-    const uint32_t countSentTotalNonRT_B = countSentHigh_B + countSentMedium_B + countSentLow_B + 1;
-    const uint32_t countSentTotal_B = countSentRealtime_B + countSentHigh_B
-                                    + countSentMedium_B + countSentLow_B + 1;
-
-    Priority priority = Priority::None;
-    //TxStream* streamPtr = nullptr;
-    //TxPacket* packetPtr = nullptr;
-    //TxStreams::PriorityMeta* metaPtr = nullptr;
+    uint32_t countSentTotal_B = 1;
+    for (const auto& it : txStreams.vec) {
+        countSentTotal_B += it.countSent_B;
+    }
+    bool isRealtime = false;
+    if (realtimePacket != nullptr) {
+        // Not more than 98 % while the others are waiting
+        isRealtime = weightedPacket == nullptr
+            or (countSentRealtime_B * 100) / countSentTotal_B < 98;
+    }
+    else if (weightedPacket == nullptr) {
+        return 0;
+    }
+    auto& ready = isRealtime ? txStreams.realtime : txStreams.weighted;
+    TxStream& turn = *ready.front();
+    TxStream* stream = &turn;
+    TxPacket* packet = isRealtime ? realtimePacket : weightedPacket;
+    if (impl->isDeadlineSchedulingEnabled) {
+        // The turn is taken by the earliest deadline of the same priority
+        findEarliestPacket(ready, turn.priority, now_us, stream, packet);
+    }
+    const uint32_t written_B = writePacketChunk(now_us, *stream, *packet, buffer, available_B);
+    if (written_B == 0) {
+        return 0;
+    }
+    txStreams.vec[size_t(stream->priority)].countSent_B += written_B;
+    if (isRealtime) {
+        // Round-robin by chunks
+        ready.pop_front();
+        ready.push_back(&turn);
+    }
+    else {
+        turn.deficit_B -= written_B;
+        if (turn.deficit_B <= 0) {
+            ready.pop_front();
+            ready.push_back(&turn);
+        }
+    }
+    return written_B;
+}
+TxPacket* UDSPSocket::Connection::findNextPacket(TxStream& stream, const int64_t now_us) {
+    processTxFifo(stream, now_us);
 
-    if (packetByPriority[size_t(Priority::Realtime)] != nullptr) {
-        if ((countSentRealtime_B * 100) / countSentTotal_B < 98) {
-            priority = Priority::Realtime;
+    while (not stream.retransmits.empty()) {
+        TxPacket* packet = stream.findPacket(stream.retransmits.front());
+        if (packet != nullptr and not packet->isAcknowledged and now_us < packet->timeout_us) {
+            return packet;
         }
-        else {
-            std::array<Priority, size_t(Priority::_count_)> priorities;
-            for (size_t i = 0, p = 0; i < size_t(Priority::_count_); ++i) {
-                for (;; ++p) {
-                    if (p >= size_t(Priority::_count_)) {
-                        p = 0;
-                    }
-                    if (packetByPriority[p] == nullptr) {
-                        continue;
-                    }
-                    priorities[i] = Priority(p++);
-                    break;
-                }
-            }
-#         if defined(NDEBUG)
-            priority = priorities[(size_t(now_us) * 48271) & 0x3];
-#         else
-            thread_local std::minstd_rand rng;
-            priority = priorities[rng() & 0x3];
-#         endif
-        }
-    }
-    // high 80%, medium 16%, low 4%
-    //
-    // 80 x + 4 x = 100
-    // x = 1.190476
-    // high 95%, low 5%
-    //
-    // 80 x + 16 x = 100
-    // x = 1.041666
-    // high 83.33%, medium 16.66%
-    //
-    // 16 x + 4 x = 100
-    // x = 5
-    // medium 80%, low 20%
-    //
-    // 000  1. - - -
-    // 001  2. - - L  100%
-    // 010  3. - M -  100%
-    // 011  4. - M L  80% 20%
-    // 100  5. H - -  100%
-    // 101  6. H - L  95% 5%
-    // 110  7. H M -  84% 16%
-    // 111  8. H M L  80% 16% 4%
-    else if (packetByPriority[size_t(Priority::High)] != nullptr) {
-        if (packetByPriority[size_t(Priority::Medium)] != nullptr) {
-            if (packetByPriority[size_t(Priority::Low)] != nullptr) {
-                // 111  8. H M L  80% 16% 4%
-                if ((countSentHigh_B * 100) / countSentTotalNonRT_B < 80) {
-                    priority = Priority::High;
-                }
-                else if ((countSentMedium_B * 100) / countSentTotalNonRT_B < 16) {
-                    priority = Priority::Medium;
-                }
-                else {
-                    priority = Priority::Low;
-                }
-            }
-            else {
-                // 110  7. H M -  84% 16%
-                if ((countSentHigh_B * 100) / countSentTotalNonRT_B < 84) {
-                    priority = Priority::High;
-                }
-                else {
-                    priority = Priority::Medium;
-                }
-            }
+        if (packet != nullptr) {
+            packet->isLost = false;
         }
-        else {
-            if (packetByPriority[size_t(Priority::Low)] != nullptr) {
-                // 101  6. H - L  95% 5%
-                if ((countSentHigh_B * 100) / countSentTotalNonRT_B < 95) {
-                    priority = Priority::High;
-                }
-                else {
-                    priority = Priority::Low;
-                }
-            }
-            else {
-                // 100  5. H - -  100%
-                priority = Priority::High;
-            }
+        stream.retransmits.pop_front();
+    }
+
+    const bool isDeadlineSchedulingEnabled = impl->isDeadlineSchedulingEnabled;
+    std::deque<TxPacket>& fifo = stream.fifo;
+    TxPacket* packetPtr = nullptr;
+    bool isDropped = false;
+    for (; stream.hasNextPacket(); ++stream.packetFifoIdx) {
+        TxPacket& packet = fifo[stream.packetFifoIdx];
+        if (packet.isAcknowledged) {
+            continue;
+        }
+        // Timed out, waiting for pop_front
+        if (packet.timeout_us <= now_us) {
+            continue;
+        }
+        // Can't be delivered in time with the current RTT and speed, so it's dropped
+        // before it takes the bandwidth of the others
+        if (isDeadlineSchedulingEnabled and not packet.isStarted
+                and now_us + getDeliveryTime_us(packet.size_B) > packet.timeout_us) {
+            packet.timeout_us = now_us - 1;
+            isDropped = true;
+            continue;
+        }
+        packetPtr = &packet;
+        break;
+    }
+#     if UDSP_TRACE_LEVEL >= UDSP_TRACE_LEVEL_STATISTICS
+    debugMaxTxQueue = std::max(debugMaxTxQueue, uint32_t(stream.packetFifoIdx));
+#     endif // UDSP_TRACE_LEVEL
+    if (isDropped) {
+        processTxFifo(stream, now_us); // to report them now
+    }
+    return packetPtr;
+}
+void UDSPSocket::Connection::detectLosses(TxStream& stream, const int64_t now_us) {
+    // Lost if a later sent packet is acknowledged (with a margin for reordering)
+    // or by the retransmission timeout. The loss times grow along the inflight.
+    const int64_t reordering_us = int64_t(RTT_us) * 9 / 8;
+    const int64_t RTO_us = getRTO_us();
+    stream.lossTime_us = INT64_MAX;
+    while (not stream.inflight.empty()) {
+        const int64_t sent_us = stream.inflight.front().first;
+        TxPacket* packet = stream.findPacket(stream.inflight.front().second);
+        if (packet == nullptr or packet->sent_us != sent_us or packet->isAcknowledged
+                or packet->isLost or packet->timeout_us <= now_us) {
+            stream.inflight.pop_front(); // delivered, sent again or timed out
+            continue;
+        }
+        const int64_t lossTime_us = sent_us
+            + (sent_us < stream.largestAckedSent_us ? reordering_us : RTO_us);
+        if (now_us < lossTime_us) {
+            stream.lossTime_us = lossTime_us;
+            break;
         }
+        stream.inflight.pop_front();
+        packet->offset_B = 0;
+        packet->isStarted = false;
+        packet->repeats.clear();
+        packet->isLost = true;
+        stream.retransmits.push_back(packet->id);
+#     if UDSP_TRACE_LEVEL >= UDSP_TRACE_LEVEL_ERROR
+        std::cout << CLR_YELLOW " Debug: TX lost packetId=" CLR_RESET << packet->id << "\n";
+#     endif // UDSP_TRACE_LEVEL
     }
-    else {
-        if (packetByPriority[size_t(Priority::Medium)] != nullptr) {
-            if (packetByPriority[size_t(Priority::Low)] != nullptr) {
-                // 011  4. - M L  80% 20%
-                if ((countSentMedium_B * 100) / countSentTotalNonRT_B < 80) {
-                    priority = Priority::Medium;
-                }
-                else {
-                    priority = Priority::Low;
-                }
-            }
-            else {
-                // 010  3. - M -  100%
-                priority = Priority::Medium;
-            }
+}
+int64_t UDSPSocket::Connection::getDeliveryTime_us(const uint64_t size_B) const {
+    // A half of RTT to the receiver and the transmission itself by the current limit
+    return RTT_us / 2 + int64_t((size_B * 1000000) / std::max(txLimit_B_s, 1u));
+}
+void UDSPSocket::Connection::findEarliestPacket(const std::deque<TxStream*>& ready,
+        const Priority priority, const int64_t now_us, TxStream*& stream, TxPacket*& packet) {
+    for (TxStream* it : ready) {
+        if (it == stream or it->priority != priority) {
+            continue;
         }
-        else {
-            if (packetByPriority[size_t(Priority::Low)] != nullptr) {
-                // 001  2. - - L  100%
-                priority = Priority::Low;
-            }
-            else {
-                // 000  1. - - -
-            }
+        TxPacket* itPacket = findNextPacket(*it, now_us);
+        if (itPacket != nullptr and itPacket->timeout_us < packet->timeout_us) {
+            stream = it;
+            packet = itPacket;
         }
     }
-    if (priority == Priority::None) {
-        return 0;
-    }
-    TxStream& stream = *streamByPriority[size_t(priority)];
-    TxPacket& packet = *packetByPriority[size_t(priority)];
-    TxStreams::PriorityMeta& priorityMeta = txStreams.vec[size_t(priority)];
-    uint32_t& countSent_B = priorityMeta.countSent_B;
-    if (++priorityMeta.vecIdx >= priorityMeta.vec.size()) {
-        priorityMeta.vecIdx = 0;
+}
+TxPacket* UDSPSocket::Connection::findReadyPacket(
+        std::deque<TxStream*>& ready, const int64_t now_us) {
+    while (not ready.empty()) {
+        TxStream& stream = *ready.front();
+        TxPacket* packet = findNextPacket(stream, now_us);
+        if (packet != nullptr) {
+            return packet;
+        }
+        ready.pop_front();
+        stream.isReady = false;
+        stream.deficit_B = 0;
+        if (stream.lossTime_us != INT64_MAX) {
+            stream.lossTimer_us = stream.lossTime_us;
+            txStreams.lossTimers.emplace(stream.lossTimer_us, stream.id);
+        }
     }
-
+    return nullptr;
+}
+uint32_t UDSPSocket::Connection::writePacketChunk(const int64_t now_us,
+        TxStream& stream, TxPacket& packet, uint8_t* buffer, const uint32_t available_B) {
     ChunkId chunkId;
     const auto packetSizeBits = ChunkId::getNumberOfBits(packet.size_B);
     const uint32_t packetSizeBytes_B = ChunkId::getNumberOfBytes(packetSizeBits);
@@ -469,7 +795,7 @@ uint32_t UDSPSocket::Connection::writeDataChunk(const int64_t now_us,
         if (smallPacket_B <= available_B) {
             chunkId.smallPacket.chunkType = ChunkId::Type::SmallPacket;
             chunkId.smallPacket.isReliable = packet.isReliable;
-            chunkId.smallPacket.isFront = stream.packetFifoIdx == 0;
+            chunkId.smallPacket.isFront = &packet == &stream.fifo.front();
             chunkId.smallPacket.packetSizeBits = packetSizeBits;
 
             write_u8(buffer, chunkId.total);
@@ -480,19 +806,15 @@ uint32_t UDSPSocket::Connection::writeDataChunk(const int64_t now_us,
             case ChunkId::Bits::u16:    write_u16(buffer, packet.size_B);   break;
             default:                    assert(false);                      return 0;
             }
-            write_data(buffer, packet.pointer, packet.size_B);
+            const uint8_t* data = buffer;
+            writePacketData(stream, packet, 0, uint32_t(packet.size_B), buffer);
 
-            if (not packet.isReliable) {
-                packet.isAcknowledged = true;
-                processTxFifo(stream, now_us);
-            }
-            else {
-                //packet.isStarted = true; //TODO
-                packet.datagramId = txPacketsCount;
-            }
             packet.begin_us = now_us;
+            if (stream.isFecEnabled and not packet.isReliable) {
+                addToFecGroup(now_us, stream, packet, data);
+            }
+            onPacketSent(now_us, stream, packet);
             //*countInDatagram += 1;
-            countSent_B += uint32_t(smallPacket_B);
             //std::cout << "Debug: writeDataChunk packetId=" << packet.id << "\n";
             //thread_local uint32_t debugPacketId = 0;
             //if (packet.id - debugPacketId > 1) {
@@ -513,9 +835,11 @@ uint32_t UDSPSocket::Connection::writeDataChunk(const int64_t now_us,
 
         const uint32_t beginOfPacket_B = g_chunkHeader_B + packetSizeBytes_B + 4;
         if (beginOfPacket_B <= available_B) {
+            stream.isFecClosed = true; // only consecutive SmallPackets
             chunkId.beginOfPacket.chunkType = ChunkId::Type::BeginOfPacket;
+            chunkId.beginOfPacket.hasCRC32 = not packet.isPulled;
             chunkId.beginOfPacket.isReliable = packet.isReliable;
-            chunkId.beginOfPacket.isFront = stream.packetFifoIdx == 0;
+            chunkId.beginOfPacket.isFront = &packet == &stream.fifo.front();
             chunkId.beginOfPacket.packetSizeBits = packetSizeBits;
 
             write_u8(buffer, chunkId.total);
@@ -528,12 +852,23 @@ uint32_t UDSPSocket::Connection::writeDataChunk(const int64_t now_us,
             case ChunkId::Bits::u64:    write_u64(buffer, packet.size_B);   break;
             default:                    assert(false);                      return 0;
             }
-            write_u32(buffer, 0); //TODO: CRC32?
+            // On the first BeginOfPacket, the SmallPackets don't carry it
+            if (chunkId.beginOfPacket.hasCRC32 and not packet.hasCRC32) {
+                if (packet.segments.empty()) {
+                    packet.crc32 = crc32c(0, packet.pointer, packet.size_B);
+                }
+                else {
+                    for (const auto& segment : packet.segments) {
+                        packet.crc32 = crc32c(packet.crc32, segment.data, segment.size_B);
+                    }
+                }
+                packet.hasCRC32 = true;
+            }
+            write_u32(buffer, packet.crc32);
 
             packet.isStarted = true;
             packet.begin_us = now_us;
             //packet.datagramId = packetsTxCount;
-            countSent_B += beginOfPacket_B;
             //std::cout << CLR_BLUE " Debug: TX BeginOfPacket packetId=" CLR_RESET << packet.id << "\n";
             //std::cout << "Debug: writeDataChunk packetId=" << packet.id << "\n";
             return beginOfPacket_B;
@@ -549,9 +884,12 @@ uint32_t UDSPSocket::Connection::writeDataChunk(const int64_t now_us,
             //continue;
             return 0;
         }
+        // Only the missing ranges if the receiver has reported them
+        const bool isRepeating = packet.isRepeating();
+        const uint64_t end_B = isRepeating ? packet.repeats.front().second : packet.size_B;
         const uint32_t pieceSize_B = static_cast<uint32_t>(std::min<uint64_t>(
             (available_B - pieceOfPacketMaxFor1B_B) + 1,
-            packet.size_B - packet.offset_B
+            end_B - packet.offset_B
         ));
 
         const auto pieceSizeBits = ChunkId::getNumberOfBits(pieceSize_B);
@@ -562,7 +900,7 @@ uint32_t UDSPSocket::Connection::writeDataChunk(const int64_t now_us,
 
         chunkId.pieceOfPacket.chunkType = ChunkId::Type::PieceOfPacket;
         chunkId.pieceOfPacket.isReliable = packet.isReliable;
-        chunkId.pieceOfPacket.isFront = stream.packetFifoIdx == 0;
+        chunkId.pieceOfPacket.isFront = &packet == &stream.fifo.front();
         chunkId.pieceOfPacket.offsetBits = offsetBits;
         chunkId.pieceOfPacket.pieceSizeBits = pieceSizeBits;
 
@@ -581,29 +919,123 @@ uint32_t UDSPSocket::Connection::writeDataChunk(const int64_t now_us,
         case ChunkId::Bits::u16:    write_u16(buffer, pieceSize_B);         break;
         default:                    assert(false);                          return 0;
         }
-        write_data(buffer, &packet.pointer[packet.offset_B], pieceSize_B);
+        writePacketData(stream, packet, packet.offset_B, pieceSize_B, buffer);
 
         packet.offset_B += pieceSize_B;
-        if (not packet.isReliable and packet.offset_B >= packet.size_B) {
-            packet.isAcknowledged = true;
-            processTxFifo(stream, now_us);
-        }
-        else {
-            if (packet.offset_B >= packet.size_B) {
-                packet.offset_B = 0;
-                packet.isStarted = false; //TODO
-            }
-            else {
-                packet.isStarted = true; //TODO
+        if (packet.offset_B >= end_B) {
+            if (isRepeating) {
+                packet.repeats.erase(packet.repeats.begin());
+                if (not packet.repeats.empty()) {
+                    packet.offset_B = packet.repeats.front().first;
+                    return pieceOfPacket_B;
+                }
             }
-            packet.datagramId = txPacketsCount;
+            packet.offset_B = 0;
+            packet.isStarted = false; // from the beginning if lost
+            onPacketSent(now_us, stream, packet);
         }
-        countSent_B += pieceOfPacket_B;
         //std::cout << "Debug: writeDataChunk packetId=" << packet.id << "\n";
         return pieceOfPacket_B;
     }
     //return 0;
 }
+void UDSPSocket::Connection::onPacketSent(const int64_t now_us,
+        TxStream& stream, TxPacket& packet) {
+    if (packet.isLost) {
+        packet.isLost = false;
+        stream.retransmits.pop_front(); // it was the front one
+    }
+    else {
+        ++stream.packetFifoIdx;
+    }
+    if (not packet.isReliable) {
+        if (stream.isInFecGroup(packet.id)) {
+            return; // acknowledged by the parity
+        }
+        packet.isAcknowledged = true;
+        processTxFifo(stream, now_us);
+        return;
+    }
+    if (not packet.repeats.empty()) {
+        // Reported during the sending
+        packet.offset_B = packet.repeats.front().first;
+        packet.isStarted = true;
+        packet.isLost = true;
+        stream.retransmits.push_back(packet.id);
+        return;
+    }
+    packet.sent_us = now_us;
+    stream.inflight.emplace_back(now_us, packet.id);
+}
+uint8_t UDSPSocket::Connection::getFecGroupSize() const {
+    if (txPacketsLoss_prc < g_fecMinLoss_prc) {
+        return 0;
+    }
+    return uint8_t(std::min(std::max(g_fecLossK / txPacketsLoss_prc, 2.0f),
+        float(g_fecMaxGroupSize)));
+}
+void UDSPSocket::Connection::writePacketData(const TxStream& stream, const TxPacket& packet,
+        const uint64_t offset_B, const uint32_t size_B, uint8_t*& buffer) {
+    if (packet.isPulled) {
+        onSend(packet.context, this, offset_B, size_B, buffer, stream.id);
+        buffer += size_B;
+        return;
+    }
+    if (packet.segments.empty()) {
+        write_data(buffer, &packet.pointer[offset_B], size_B);
+        return;
+    }
+    uint64_t begin_B = 0;
+    uint64_t left_B = size_B;
+    for (const auto& segment : packet.segments) {
+        const uint64_t end_B = begin_B + segment.size_B;
+        if (left_B == 0) {
+            break;
+        }
+        if (offset_B + (size_B - left_B) < end_B) {
+            const uint64_t from_B = offset_B + (size_B - left_B) - begin_B;
+            const uint64_t piece_B = std::min(segment.size_B - from_B, left_B);
+            write_data(buffer, static_cast<const uint8_t*>(segment.data) + from_B, piece_B);
+            left_B -= piece_B;
+        }
+        begin_B = end_B;
+    }
+}
+void UDSPSocket::Connection::addToFecGroup(const int64_t now_us,
+        TxStream& stream, const TxPacket& packet, const uint8_t* data) {
+    if (stream.fecCount == 0) {
+        stream.fecGroupSize = getFecGroupSize();
+        if (stream.fecGroupSize == 0 or packet.size_B > g_fecMaxPacketSize_B) {
+            return;
+        }
+        stream.fecParity.clear();
+        stream.fecSizesXor = 0;
+        stream.fecFirstPacketId = packet.id;
+        // The later packets wait for the parity in the receiver
+        stream.fecDeadline_us = now_us + std::max<int64_t>(RTT_us / 2, g_fecMinGroupTime_us);
+        stream.isFecClosed = false;
+        txStreams.fecStreams.push_back(stream.id);
+    }
+    else if (stream.isFecClosed) {
+        return; // not protected until the parity is sent
+    }
+    else if (packet.size_B > g_fecMaxPacketSize_B
+            or packet.id != stream.fecFirstPacketId + stream.fecCount) {
+        stream.isFecClosed = true;
+        return;
+    }
+    if (stream.fecParity.size() < packet.size_B) {
+        stream.fecParity.resize(packet.size_B);
+    }
+    for (uint32_t i = 0; i < packet.size_B; ++i) {
+        stream.fecParity[i] ^= data[i];
+    }
+    stream.fecSizesXor ^= packet.size_B;
+    stream.fecDatagramId = txPacketsCount;
+    if (++stream.fecCount >= stream.fecGroupSize) {
+        stream.isFecClosed = true;
+    }
+}
 uint32_t UDSPSocket::Connection::writeChunk(const int64_t now_us,
         uint8_t* buffer, const uint32_t available_B) {
     const uint32_t written_B = writeMetaChunk(now_us, buffer, available_B);
@@ -625,6 +1057,114 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
     //std::cout << "Debug: readChunk packetId=" << packetId << "\n";
     switch (ChunkId::Type(chunkId.type.chunkType)) { // GCC 4.9
     case ChunkId::Type::SmallPacket: {
+        if (chunkId.smallPacket.isAcknowledge and not chunkId.smallPacket.isReliable
+                and chunkId.smallPacket.isRanges) {
+            const ChunkId::Bits sizeBits = chunkId.smallPacket.packetSizeBits;
+            const uint32_t sizeBytes_B = ChunkId::getNumberOfBytes(sizeBits);
+            if (g_chunkHeader_B + 1 + sizeBytes_B * 2 > available_B) {
+                return 0;
+            }
+            const uint8_t count = read_u8(buffer);
+            const uint64_t paritySize_B = read_bits(buffer, sizeBits);
+            const uint64_t sizesXor = read_bits(buffer, sizeBits);
+            const uint64_t chunkSize_B = g_chunkHeader_B + 1 + sizeBytes_B * 2 + paritySize_B;
+            if (chunkSize_B > available_B) {
+                return 0;
+            }
+            auto& stream = rxStreams.map[streamId];
+            if (stream.isNew) {
+                stream.isNew = false;
+                stream.id = streamId;
+                stream.get(now_us);
+                rxStreams.isStreamsChanged = true;
+            }
+            // A single lost packet of the group is rebuilt, not mixed with the next group
+            // XOR of the received packets of the group
+            std::vector<uint8_t> parity(buffer, buffer + paritySize_B);
+            uint64_t size_B = sizesXor;
+            uint32_t lostId = packetId;
+            uint32_t received = 0;
+            for (auto it = stream.fecPackets.begin(); it != stream.fecPackets.end();) {
+                const uint32_t idx = it->id - packetId;
+                if (idx >= UINT32_MAX / 2) {
+                    it = stream.fecPackets.erase(it); // of a lost parity
+                    continue;
+                }
+                if (idx < count) {
+                    for (size_t i = 0; i < it->data.size() and i < parity.size(); ++i) {
+                        parity[i] ^= it->data[i];
+                    }
+                    size_B ^= it->data.size();
+                    lostId ^= it->id;
+                    ++received;
+                    it = stream.fecPackets.erase(it);
+                    continue;
+                }
+                ++it;
+            }
+            if (received + 1 == count) {
+                for (uint32_t i = 1; i < count; ++i) {
+                    lostId ^= packetId + i;
+                }
+                if (0 < size_B and size_B <= paritySize_B
+                        and lostId - packetId < count
+                        and not stream.isReceivedBefore(lostId)) {
+                    auto& packet = stream.get(now_us, lostId);
+                    if (packet.id == lostId and not packet.isReceived) {
+                        packet.isReceived = true;
+                        packet.size_B = size_B;
+                        packet.copy.assign(parity.begin(), parity.begin() + size_B);
+                    }
+                    processRxFifo(stream, now_us);
+                }
+            }
+            if (not stream.isFec or packetId + count - stream.fecNextPacketId < UINT32_MAX / 2) {
+                stream.fecNextPacketId = packetId + count;
+            }
+            stream.isFec = true;
+            return uint32_t(chunkSize_B);
+        }
+        if (chunkId.smallPacket.isAcknowledge and not chunkId.smallPacket.isReliable) {
+            ackEveryN = std::max<uint8_t>(1, streamId);
+            maxAckDelay_us = std::min(packetId, g_maxAckDelay_us);
+            return g_chunkHeader_B;
+        }
+        if (chunkId.smallPacket.isAcknowledge and chunkId.smallPacket.isRanges) {
+            if (g_ackRangesHeader_B > available_B) {
+                return 0;
+            }
+            const uint8_t count = read_u8(buffer);
+            const uint32_t chunkSize_B = g_ackRangesHeader_B + count * g_ackRange_B;
+            if (chunkSize_B > available_B) {
+                return 0;
+            }
+            auto streamIt = txStreams.map.find(streamId);
+            if (streamIt == txStreams.map.end()) {
+                return chunkSize_B;
+            }
+            auto& stream = streamIt->second;
+            uint32_t rangeBegin = packetId;
+            for (uint8_t i = 0; i < count; ++i) {
+                rangeBegin += read_u16(buffer);
+                const uint16_t length = read_u16(buffer);
+                if (not stream.fifo.empty()) {
+                    // The ids in the fifo are consecutive
+                    const uint32_t frontId = stream.fifoShadow.front();
+                    for (uint32_t id = rangeBegin; id != rangeBegin + length; ++id) {
+                        const uint32_t packetIdx = id - frontId;
+                        if (packetIdx < stream.fifo.size()) {
+                            auto& packet = stream.fifo[packetIdx];
+                            packet.isAcknowledged = true;
+                            stream.largestAckedSent_us = std::max(
+                                stream.largestAckedSent_us, packet.sent_us);
+                        }
+                    }
+                }
+                rangeBegin += length;
+            }
+            processTxFifo(stream, now_us);
+            return chunkSize_B;
+        }
         if (chunkId.smallPacket.isAcknowledge) {
             //if (not chunkId.smallPacket.isReliable) {
             //    return 0;
@@ -642,7 +1182,9 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
                 //std::cout << CLR_RED << packetId << CLR_RESET "\n";
                 return g_chunkHeader_B;
             }
-            stream.fifo[packetIdx].isAcknowledged = true;
+            auto& packet = stream.fifo[packetIdx];
+            packet.isAcknowledged = true;
+            stream.largestAckedSent_us = std::max(stream.largestAckedSent_us, packet.sent_us);
             processTxFifo(stream, now_us);
             //std::cout << CLR_GREEN << packetId << CLR_RESET "\n";
             return g_chunkHeader_B;
@@ -689,12 +1231,7 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
         }
         if (stream.isReceivedBefore(packetId)) {
             if (chunkId.smallPacket.isReliable) {
-                if (not rxStreams.acks.empty()
-                        and rxStreams.acks.back().first == streamId
-                        and rxStreams.acks.back().second == packetId) {
-                    return chunkSize_B;
-                }
-                rxStreams.acks.emplace_back(streamId, packetId);
+                rxStreams.acknowledge(stream, packetId, now_us);
             }
             return chunkSize_B;
         }
@@ -709,6 +1246,9 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
         packet.timeout_us = now_us + RTT_us * g_rxFifoCleanupK;
         if (not packet.isReceived) {
             packet.isReceived = true;
+            if (size_B <= g_fecMaxPacketSize_B) {
+                stream.addToFecGroup(packetId, buffer, size_B);
+            }
             if (stream.fifo.front().id == packetId) {
                 if (onReceived != nullptr) {
                     onReceived(
@@ -730,13 +1270,7 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
             }
         }
         if (chunkId.smallPacket.isReliable) {
-            if (not rxStreams.acks.empty()
-                    and rxStreams.acks.back().first == streamId
-                    and rxStreams.acks.back().second == packetId) {
-            }
-            else {
-                rxStreams.acks.emplace_back(streamId, packetId);
-            }
+            rxStreams.acknowledge(stream, packetId, now_us);
         }
         processRxFifo(stream, now_us);
         return chunkSize_B;
@@ -744,7 +1278,7 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
     case ChunkId::Type::BeginOfPacket: {
         const uint32_t packetSizeBytes_B = ChunkId::getNumberOfBytes(
             chunkId.beginOfPacket.packetSizeBits);
-        const uint32_t chunkSize_B = g_chunkHeader_B + packetSizeBytes_B + 4; //TODO: CRC32?
+        const uint32_t chunkSize_B = g_chunkHeader_B + packetSizeBytes_B + 4;
         if (chunkSize_B > available_B) {
             return 0;
         }
@@ -788,12 +1322,35 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
         packet.timeout_us = now_us + RTT_us * g_rxFifoCleanupK;
         if (packet.size_B == 0) {
             packet.size_B = packetSize_B;
-            packet.crc32 = read_u32(buffer); //TODO: CRC32?
+            packet.crc32 = read_u32(buffer);
+            packet.hasCRC32 = chunkId.beginOfPacket.hasCRC32;
             packet.id = packetId;
             packet.isReliable = chunkId.beginOfPacket.isReliable;
-            if (packetSize_B <= impl->rxPacketBufferSizeThreshold_B) {
+            if (packetSize_B <= impl->rxPacketBufferSizeThreshold_B
+                    and packet.copy.size() <= packetSize_B) {
+                // With the pieces received before
                 packet.copy.resize(packetSize_B);
+                packet.isGapsChanged = not packet.ranges.empty();
+                if (packet.offset_B >= packet.size_B) {
+                    packet.isReceived = true;
+                    packet.checkCRC32();
+                    if (packet.isReliable) {
+                        rxStreams.acknowledge(stream, packetId, now_us);
+                    }
+                }
             }
+            else {
+                if (packet.offset_B != 0 or not packet.ranges.empty()) {
+                    packet.offsetRepeat_B = 0;
+                }
+                packet.copy.clear();
+                packet.ranges.clear();
+                packet.offset_B = 0;
+                if (packetSize_B <= impl->rxPacketBufferSizeThreshold_B) {
+                    packet.copy.resize(packetSize_B);
+                }
+            }
+            packet.repeat_us = 0;
         }
         processRxFifo(stream, now_us);
         //if (stream.frontPacketId < stream.fifoShadow.front()) {
@@ -845,12 +1402,7 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
         }
         if (stream.isReceivedBefore(packetId)) {
             if (chunkId.pieceOfPacket.isReliable) {
-                if (not rxStreams.acks.empty()
-                        and rxStreams.acks.back().first == streamId
-                        and rxStreams.acks.back().second == packetId) {
-                    return chunkSize_B;
-                }
-                rxStreams.acks.emplace_back(streamId, packetId);
+                rxStreams.acknowledge(stream, packetId, now_us);
             }
             return chunkSize_B;
         }
@@ -864,53 +1416,68 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
         //processRxFifo(stream, now_us);
 
         packet.timeout_us = now_us + RTT_us * g_rxFifoCleanupK;
-        if (packet.size_B == 0) {
-            packet.offsetRepeat_B = 0;
+        if (packet.size_B == 0) { // BeginOfPacket is lost or reordered
             packet.isReliable = chunkId.pieceOfPacket.isReliable;
+            if (offset_B + pieceSize_B <= impl->rxPacketBufferSizeThreshold_B) {
+                if (packet.copy.size() < offset_B + pieceSize_B) {
+                    packet.copy.resize(offset_B + pieceSize_B);
+                }
+                std::copy(&buffer[0], &buffer[pieceSize_B], &packet.copy[offset_B]);
+                packet.addRange(offset_B, offset_B + pieceSize_B);
+            }
+            if (packet.repeat_us == 0) {
+                packet.repeat_us = now_us; // may be only reordered
+            }
             return chunkSize_B;
         }
         if (offset_B + pieceSize_B > packet.size_B) {
             //TODO: What to do with the wrong piece?
             return chunkSize_B;
         }
-        if (offset_B < packet.offset_B) { // Already received
-            return chunkSize_B;
-        }
-        if (packet.offset_B != offset_B) { // Need to repeat
-            packet.offset_B = offset_B;
-            packet.offsetRepeat_B = packet.offset_B;
-            packet.sizeRepeat_B = offset_B - packet.offset_B;
+        if (offset_B + pieceSize_B <= packet.offset_B) { // Already received
             return chunkSize_B;
         }
         if (not packet.copy.empty()) {
             assert(offset_B + pieceSize_B <= packet.copy.size());
             std::copy(&buffer[0], &buffer[pieceSize_B], &packet.copy[offset_B]);
+            // Only the gaps are repeated
+            if (packet.addRange(offset_B, offset_B + pieceSize_B)) {
+                packet.isGapsChanged = true;
+            }
         }
-        else if (stream.frontPacketId != packetId) { // Repeat due to incorrect order
-            //TODO: Receive into the copy
+        else if (stream.frontPacketId != packetId) { // Too big, streamed only in order
+            if (packet.repeat_us + RTT_us * 2 <= now_us) {
+                packet.repeat_us = now_us;
+                packet.offsetRepeat_B = 0;
+            }
             packet.offset_B = 0;
-            packet.offsetRepeat_B = 0;
-            packet.sizeRepeat_B = packet.size_B;
             return chunkSize_B;
         }
-        else if (onReceived != nullptr) {
-            //TODO: check CRC32
-            packet.context = onReceived(
-                packet.context, this, &buffer[0], pieceSize_B, offset_B, streamId, 'p'
-            );
+        else if (packet.offset_B < offset_B) { // Need to repeat, once per RTT * 2
+            if (packet.repeat_us + RTT_us * 2 <= now_us) {
+                packet.repeat_us = now_us;
+                packet.offsetRepeat_B = packet.offset_B;
+            }
+            return chunkSize_B;
+        }
+        else {
+            // Only the new part of the piece
+            const uint64_t skip_B = packet.offset_B - offset_B;
+            if (packet.hasCRC32) {
+                packet.crc32Streamed = crc32c(packet.crc32Streamed,
+                    &buffer[skip_B], pieceSize_B - skip_B);
+            }
+            if (onReceived != nullptr) {
+                packet.context = onReceived(packet.context, this, &buffer[skip_B],
+                    pieceSize_B - skip_B, packet.offset_B, streamId, 'p');
+            }
+            packet.offset_B = offset_B + pieceSize_B;
         }
-        packet.offset_B = offset_B + pieceSize_B;
         if (packet.offset_B >= packet.size_B) {
-            //TODO: check CRC32
             packet.isReceived = true;
+            packet.checkCRC32();
             if (packet.isReliable) {
-                if (not rxStreams.acks.empty()
-                        and rxStreams.acks.back().first == streamId
-                        and rxStreams.acks.back().second == packetId) {
-                }
-                else {
-                    rxStreams.acks.emplace_back(streamId, packetId);
-                }
+                rxStreams.acknowledge(stream, packetId, now_us);
             }
             processRxFifo(stream, now_us);
         }
@@ -921,26 +1488,21 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
             chunkId.repeatInfo.repeatOffsetBits);
         const uint32_t repeatSizeBytes_B = ChunkId::getNumberOfBytes(
             chunkId.repeatInfo.repeatSizeBits);
-        const uint32_t chunkSize_B = g_chunkHeader_B + repeatOffsetBytes_B + repeatSizeBytes_B;
+        const ChunkId::Bits repeatOffsetBits = chunkId.repeatInfo.repeatOffsetBits;
+        const ChunkId::Bits repeatSizeBits = chunkId.repeatInfo.repeatSizeBits;
+        uint32_t count = 1;
+        if (chunkId.repeatInfo.isRanges) {
+            if (g_chunkHeader_B + 1 > available_B) {
+                return 0;
+            }
+            count = read_u8(buffer);
+        }
+        const uint32_t chunkSize_B = chunkId.repeatInfo.isRanges
+            ? g_chunkHeader_B + 1 + count * (repeatOffsetBytes_B + repeatSizeBytes_B)
+            : g_chunkHeader_B + repeatOffsetBytes_B + repeatSizeBytes_B;
         if (chunkSize_B > available_B) {
             return 0;
         }
-        uint64_t repeatOffset_B = 0;
-        switch (ChunkId::Bits(chunkId.repeatInfo.repeatOffsetBits)) { // GCC 4.9
-        case ChunkId::Bits::u8:     repeatOffset_B = read_u8(buffer);   break;
-        case ChunkId::Bits::u16:    repeatOffset_B = read_u16(buffer);  break;
-        case ChunkId::Bits::u32:    repeatOffset_B = read_u32(buffer);  break;
-        case ChunkId::Bits::u64:    repeatOffset_B = read_u64(buffer);  break;
-        default:                                                        return 0;
-        }
-        uint64_t repeatSize_B = 0; //TODO: Not implemented
-        switch (ChunkId::Bits(chunkId.repeatInfo.repeatSizeBits)) { // GCC 4.9
-        case ChunkId::Bits::u8:     repeatSize_B = read_u8(buffer);     break;
-        case ChunkId::Bits::u16:    repeatSize_B = read_u16(buffer);    break;
-        case ChunkId::Bits::u32:    repeatSize_B = read_u32(buffer);    break;
-        case ChunkId::Bits::u64:    repeatSize_B = read_u64(buffer);    break;
-        default:                                                        return 0;
-        }
 #     if UDSP_TRACE_LEVEL >= UDSP_TRACE_LEVEL_ERROR
         std::cout << CLR_YELLOW " Debug: RX RepeatInfo packetId=" CLR_RESET << packetId << "\n";
 #     endif // UDSP_TRACE_LEVEL
@@ -949,17 +1511,46 @@ uint32_t UDSPSocket::Connection::readChunk(const int64_t now_us, const uint8_t*
             return chunkSize_B;
         }
         auto& stream = streamIt->second;
-        const size_t packetIdx = findPacketIdx(stream.fifoShadow, packetId);
-        if (packetIdx == SIZE_MAX) {
+        TxPacket* packet = stream.findPacket(packetId);
+        if (packet == nullptr or not packet->isReliable or packet->isAcknowledged) {
             return chunkSize_B;
         }
-        auto& packet = stream.fifo[packetIdx];
-        if (not packet.isReliable) {
-            return chunkSize_B;
+        if (not chunkId.repeatInfo.isRanges) {
+            const uint64_t repeatOffset_B = read_bits(buffer, repeatOffsetBits);
+            read_bits(buffer, repeatSizeBits); // to the end
+            packet->repeats.clear();
+            packet->offset_B = std::min(repeatOffset_B, packet->size_B);
+            packet->isStarted = packet->offset_B != 0;
         }
-        packet.offset_B = repeatOffset_B;
-        if (repeatOffset_B == 0) {
-            packet.isStarted = false;
+        else if (packet->isLost and packet->repeats.empty()) {
+            return chunkSize_B; // the whole packet is being sent again
+        }
+        else {
+            for (uint32_t i = 0; i < count; ++i) {
+                const uint64_t repeatOffset_B = read_bits(buffer, repeatOffsetBits);
+                const uint64_t repeatSize_B = read_bits(buffer, repeatSizeBits);
+                if (repeatSize_B == 0 or repeatOffset_B + repeatSize_B > packet->size_B) {
+                    continue;
+                }
+                const auto range = std::make_pair(repeatOffset_B, repeatOffset_B + repeatSize_B);
+                if (std::find(packet->repeats.begin(), packet->repeats.end(), range)
+                        == packet->repeats.end()) {
+                    packet->repeats.push_back(range);
+                }
+            }
+            if (packet->repeats.empty()) {
+                return chunkSize_B;
+            }
+        }
+        // A gap reported by the receiver, the missing part is sent again
+        if (packet->sent_us != 0 and not packet->isLost) {
+            if (not packet->repeats.empty()) {
+                packet->offset_B = packet->repeats.front().first;
+                packet->isStarted = true;
+            }
+            packet->isLost = true;
+            stream.retransmits.push_back(packet->id);
+            txStreams.setReady(stream);
         }
         return chunkSize_B;
     }
@@ -977,8 +1568,9 @@ void UDSPSocket::Connection::processRxFifo(RxStream& stream, const int64_t now_u
         if (packet.isReceived) {
             if (onReceived) {
                 onReceived(
-                    packet.context, this, packet.copy.empty() ? nullptr : packet.copy.data(),
-                    packet.size_B, 0, stream.id, 's'
+                    packet.context, this,
+                    packet.copy.empty() or packet.isCorrupted ? nullptr : packet.copy.data(),
+                    packet.size_B, 0, stream.id, packet.isCorrupted ? 'b' : 's'
                 );
             }
             stream.debugPacketId = packet.id;
@@ -1048,10 +1640,24 @@ void UDSPSocket::Connection::processTxFifo(TxStream& stream, const int64_t now_u
             --stream.packetFifoIdx;
         }
     }
+    detectLosses(stream, now_us);
+    // The window of 1 << 17 packets could be moved
+    if (stream.hasNextPacket()) {
+        txStreams.setReady(stream);
+    }
 }
 
 void UDSPSocket::Connection::onDisconnected() {
     commands.clear();
+    const auto drop = [this](TxCommand& cell, const uint32_t cellIdx) {
+        if (cell.hasPayload) {
+            txPayloads[cellIdx] = TxPayload(); // a Buffer goes back to its owner
+        }
+    };
+    while (txCommands.popWith(drop)) {
+    }
+    txSpill.clear();
+    isTxSpilled = false;
     connectionId = 0;
 
     //const bool hasOnDelivered = impl->onDelivered != nullptr;
@@ -1068,8 +1674,7 @@ void UDSPSocket::Connection::onDisconnected() {
             }
         }
     }
-    txStreams.map.clear();
-    txStreams.isStreamsChanged = true;
+    txStreams.clear();
     for (auto& it : txStreams.vec) {
         it.countSent_B = 0;
     }
@@ -1088,7 +1693,8 @@ void UDSPSocket::Connection::onDisconnected() {
             }
         }
     }
-    rxStreams.acks.clear();
+    rxStreams.ackStreams.clear();
+    rxStreams.acksCount = 0;
     rxStreams.map.clear();
     rxStreams.isStreamsChanged = true;
 }
@@ -19,6 +19,44 @@ void UDSPSocket::Impl::testStreams() {
         assert(Connection::findPacketIdx(fifo, 2) == 4);
         assert(Connection::findPacketIdx(fifo, 3) == SIZE_MAX);
     }
+    {
+        MPSCQueue<uint32_t, 4> queue;
+        uint32_t value = 0;
+        assert(not queue.pop(value));
+        for (uint32_t i = 0; i < 4; ++i) {
+            assert(queue.push(uint32_t(i)));
+        }
+        assert(not queue.push(4)); // full
+        assert(queue.pop(value) and value == 0);
+        assert(queue.push(4)); // wrapped
+        for (uint32_t i = 1; i <= 4; ++i) {
+            assert(queue.pop(value) and value == i);
+        }
+        assert(not queue.pop(value));
+    }
+    {
+        TimerWheel timers;
+        const int64_t now_us = tick_us();
+        timers.schedule(1, now_us + 5 * 1000);
+        timers.schedule(2, now_us + 700 * 1000); // second level
+        timers.schedule(3, INT64_MAX); // ignored
+        std::vector<uint64_t> expired;
+        const auto onExpired = [&expired](const uint64_t key, const int64_t deadline_us) {
+            assert(deadline_us != INT64_MAX);
+            expired.push_back(key);
+        };
+        timers.expire(now_us + 4 * 1000, onExpired);
+        assert(expired.empty());
+        assert(timers.getNextDeadline_us() >= now_us + 5 * 1000);
+        timers.expire(now_us + 6 * 1000, onExpired);
+        assert(expired.size() == 1 and expired[0] == 1);
+        assert(timers.getNextDeadline_us() == now_us + 700 * 1000);
+        timers.expire(now_us + 699 * 1000, onExpired);
+        assert(expired.size() == 1);
+        timers.expire(now_us + 702 * 1000, onExpired);
+        assert(expired.size() == 2 and expired[1] == 2);
+        assert(timers.getNextDeadline_us() == INT64_MAX);
+    }
     {
         RxStream rxStream;
         // t1: |0| 1 2 3
@@ -291,32 +329,54 @@ void UDSPSocket::Impl::testStreams() {
     assert(readed_B == 0); // nothing to read
     assert(count == 1);
 
+    // "1" and "3" acks are pending
+    assert(b.rxStreams.isAckDue(2, 10 * 1000000, now_us));
+    assert(not b.rxStreams.isAckDue(3, 10 * 1000000, now_us));
+    assert(b.rxStreams.isAckDue(3, 1000, now_us));
+    assert(b.writeMetaChunk(now_us, &b.txBuffer[0], b.txBuffer.size(), false) == 0);
+
+    // the requested ack frequency
+    a.peerAckEveryN = 3;
+    a.peerMaxAckDelay_us = 100 * 1000;
+    a.isAckFrequencyChanged = true;
+    written_B = a.writeMetaChunk(now_us, &a.txBuffer[0], a.txBuffer.size(), false);
+    assert(written_B == 6);
+    readed_B = b.readChunk(now_us, &a.txBuffer[0], written_B);
+    assert(readed_B == 6);
+    assert(b.ackEveryN == 3 and b.maxAckDelay_us == 100 * 1000);
+    assert(a.getRTO_us() == a.RTT_us * 2 + 100 * 1000);
+    a.peerAckEveryN = 1; // reset to the default
+    a.peerMaxAckDelay_us = 0;
+    a.isAckFrequencyChanged = true;
+    written_B = a.writeMetaChunk(now_us, &a.txBuffer[0], a.txBuffer.size(), false);
+    assert(written_B == 6 and a.txBuffer[1] == 1);
+    a.txBuffer[1] = 0; // ackEveryN 0 is the same as 1
+    readed_B = b.readChunk(now_us, &a.txBuffer[0], written_B);
+    assert(readed_B == 6);
+    assert(b.ackEveryN == 1 and b.maxAckDelay_us == 0);
+    assert(a.getRTO_us() == std::max<int64_t>(1000, a.RTT_us * 2));
+
     b.nextDatagram();
     std::fill(b.txBuffer.begin(), b.txBuffer.end(), 0);
     offset_B = 0;
     written_B = b.writeChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
-    assert(written_B != 0); // writted "1" ack
-    // ignored "3" ack
+    assert(written_B == 6 + 1 + 2 * 4); // "1" and "3" acks as two ranges
+    offset_B += written_B;
+    written_B = b.writeChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
+    assert(written_B == 0); // nothing to write
 
     a.onDelivered = nullptr;
     offset_B = 0;
     readed_B = a.readChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
-    assert(readed_B != 0); // readed "1" ack
+    assert(readed_B != 0); // readed "1" and "3" acks
     assert(count == 1);
 
     now_us += 1 * 1000000;
     a.nextDatagram();
-    std::fill(a.txBuffer.begin(), a.txBuffer.end(), 0);
-    offset_B = 0;
-    written_B = a.writeChunk(now_us, &a.txBuffer[offset_B], a.txBuffer.size() - offset_B);
-    assert(written_B != 0); // writted "3"
-    offset_B += written_B;
-    written_B = a.writeChunk(now_us, &a.txBuffer[offset_B], a.txBuffer.size() - offset_B);
+    written_B = a.writeChunk(now_us, &a.txBuffer[0], a.txBuffer.size());
     assert(written_B == 0); // nothing to write
-
-    offset_B = 0;
-    readed_B = b.readChunk(now_us, &a.txBuffer[offset_B], a.txBuffer.size() - offset_B);
-    assert(readed_B != 0); // readed "3" and ingored
+    written_B = b.writeChunk(now_us, &b.txBuffer[0], b.txBuffer.size());
+    assert(written_B == 0); // timed out "2" and delivered "3" by the cleanup
     assert(count == 3);
 
     a.onDisconnected();
@@ -391,9 +451,9 @@ void UDSPSocket::Impl::testStreams() {
     a.nextDatagram();
     std::fill(b.txBuffer.begin(), b.txBuffer.end(), 0);
     offset_B = 0;
-    for (uint8_t i = 0; i < 10; ++i) {
+    for (uint8_t i = 0; i < 5; ++i) { // a range of two acks per stream
         written_B = b.writeChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
-        assert(written_B != 0);
+        assert(written_B == 6 + 1 + 4);
         offset_B += written_B;
     }
     written_B = b.writeChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
@@ -407,7 +467,7 @@ void UDSPSocket::Impl::testStreams() {
         count += static_cast<const char*>(data)[0];
     };
     offset_B = 0;
-    for (uint8_t i = 0; i < 10; ++i) {
+    for (uint8_t i = 0; i < 5; ++i) {
         readed_B = a.readChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
         assert(readed_B != 0);
         offset_B += readed_B;
@@ -496,6 +556,9 @@ void UDSPSocket::Impl::testStreams() {
     std::fill(b.txBuffer.begin(), b.txBuffer.end(), 0);
     offset_B = 0;
     written_B = b.writeChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
+    assert(written_B == 0); // BeginOfPacket may be only reordered
+    now_us += b.RTT_us * 2;
+    written_B = b.writeChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
     assert(written_B != 0); // writted RepeatInfo
     offset_B += written_B;
     written_B = b.writeChunk(now_us, &b.txBuffer[offset_B], b.txBuffer.size() - offset_B);
@@ -848,6 +911,348 @@ void UDSPSocket::Impl::testStreams() {
         } while (readed_B > 0);
     }
 
+    // weighted streams, 3:1 by chunks of 8 B
+
+    a.onDisconnected();
+    b.onDisconnected();
+    a.onDelivered = nullptr;
+    now_us += 1 * 1000000;
+    setTxQuantum_ts(&a, 8);
+    setTxStreamWeight_ts(&a, 10, 3);
+    setTxStreamWeight_ts(&a, 11, 1);
+    for (uint8_t i = 0; i < 16; ++i) {
+        send_ts(0, &a, "A", 1, false, 10, 5000, now_us);
+        send_ts(0, &a, "B", 1, false, 11, 5000, now_us);
+    }
+    a.doCommands();
+    a.nextDatagram();
+    {
+        uint32_t count10 = 0;
+        uint32_t count11 = 0;
+        for (uint8_t i = 0; i < 16; ++i) {
+            written_B = a.writeChunk(now_us, &a.txBuffer[0], uint32_t(a.txBuffer.size()));
+            assert(written_B == 8);
+            if (a.txBuffer[1] == 10) {
+                ++count10;
+            }
+            else if (a.txBuffer[1] == 11) {
+                ++count11;
+            }
+        }
+        assert(count10 == 12 and count11 == 4);
+    }
+    a.onDisconnected();
+
+    // more sends than the queue holds, the rest is spilled in order
+
+    for (uint32_t i = 0; i < Connection::g_txCommandsSize + 16; ++i) {
+        assert(send_ts(i, &a, "A", 1, true, 12, 5000, now_us));
+    }
+    assert(a.isTxSpilled);
+    a.doCommands();
+    assert(not a.isTxSpilled);
+    {
+        const auto& fifo = a.txStreams.map[12].fifo;
+        assert(fifo.size() == Connection::g_txCommandsSize + 16);
+        for (uint32_t i = 0; i < fifo.size(); ++i) {
+            assert(fifo[i].context == i and fifo[i].copy.size() == 1);
+        }
+    }
+    a.onDisconnected();
+
+    // earliest deadline first, the infeasible packet is dropped
+
+    isDeadlineSchedulingEnabled = true;
+    now_us += 1 * 1000000;
+    setTxStreamPriority_ts(&a, 20, 'r');
+    setTxStreamPriority_ts(&a, 21, 'r');
+    setTxStreamPriority_ts(&a, 22, 'r');
+    send_ts(0, &a, "A", 1, false, 20, 5000, now_us);
+    send_ts(0, &a, "B", 1, false, 21, 1000, now_us);
+    send_ts(0, &a, "C", 1, false, 22, 10, now_us);
+    a.doCommands();
+    a.nextDatagram();
+    a.txLimit_B_s = 100; // 1 B in 10 ms
+    count = 0;
+    a.onDelivered = [&](uintptr_t context, Connection* connection, const void* data,
+            uint64_t size_B, uint8_t streamId, char status) {
+        if (status == 't') {
+            assert(streamId == 22);
+            ++count;
+        }
+    };
+    written_B = a.writeChunk(now_us, &a.txBuffer[0], uint32_t(a.txBuffer.size()));
+    assert(written_B == 8 and a.txBuffer[1] == 21);
+    written_B = a.writeChunk(now_us, &a.txBuffer[0], uint32_t(a.txBuffer.size()));
+    assert(written_B == 8 and a.txBuffer[1] == 20);
+    written_B = a.writeChunk(now_us, &a.txBuffer[0], uint32_t(a.txBuffer.size()));
+    assert(written_B == 0);
+    assert(count == 1);
+    isDeadlineSchedulingEnabled = false;
+    a.onDelivered = nullptr;
+    a.onDisconnected();
+
+    // "1" and "2" are lost by the later acknowledged "3", then sent first
+
+    now_us += 1 * 1000000;
+    a.RTT_us = 1000;
+    send_ts(0, &a, "1", 1, true, 30, 5000, now_us);
+    send_ts(0, &a, "2", 1, true, 30, 5000, now_us);
+    send_ts(0, &a, "3", 1, true, 30, 5000, now_us);
+    send_ts(0, &a, "4", 1, true, 30, 5000, now_us);
+    a.doCommands();
+    a.nextDatagram();
+    for (int64_t i = 0; i < 3; ++i) {
+        written_B = a.writeChunk(now_us + i, &a.txBuffer[0], uint32_t(a.txBuffer.size()));
+        assert(written_B == 8);
+    }
+    {
+        TxStream& stream = a.txStreams.map[30];
+        assert(stream.inflight.size() == 3);
+        stream.fifo[2].isAcknowledged = true;
+        stream.largestAckedSent_us = stream.fifo[2].sent_us;
+        a.detectLosses(stream, now_us + 1000); // RTT * 9 / 8 is not passed
+        assert(stream.retransmits.empty());
+        a.detectLosses(stream, now_us + 1200);
+        assert(stream.retransmits.size() == 2);
+    }
+    a.nextDatagram();
+    written_B = a.writeChunk(now_us + 1200, &a.txBuffer[0], uint32_t(a.txBuffer.size()));
+    assert(written_B == 8 and a.txBuffer[7] == '1');
+    written_B = a.writeChunk(now_us + 1200, &a.txBuffer[0], uint32_t(a.txBuffer.size()));
+    assert(written_B == 8 and a.txBuffer[7] == '2');
+    written_B = a.writeChunk(now_us + 1200, &a.txBuffer[0], uint32_t(a.txBuffer.size()));
+    assert(written_B == 8 and a.txBuffer[7] == '4');
+    a.onDisconnected();
+
+    // single big packet (3 pieces), the second one is lost, only it is repeated
+
+    const auto transfer = [&](Connection& from, Connection& to, const bool isLost) {
+        from.nextDatagram();
+        uint32_t size_B = 0;
+        while ((written_B = from.writeChunk(now_us, &from.txBuffer[size_B],
+                uint32_t(from.txBuffer.size()) - size_B)) != 0) {
+            size_B += written_B;
+        }
+        for (uint32_t i = 0; not isLost and i < size_B; i += readed_B) {
+            readed_B = to.readChunk(now_us, &from.txBuffer[i], size_B - i);
+            assert(readed_B != 0);
+        }
+        return size_B;
+    };
+    now_us += 1 * 1000000;
+    result = 0;
+    a.onDelivered = nullptr;
+    b.onReceived = [&](uintptr_t context, Connection* connection, const void* data,
+            uint64_t size_B, uint64_t offset_B, uint8_t rxStreamId, char status) {
+        assert(status == 's' and size_B == v256.size());
+        assert(std::equal(v256.begin(), v256.end(), static_cast<const uint8_t*>(data)));
+        result = 's';
+        return uintptr_t(0);
+    };
+    setTxStreamPriority_ts(&a, 32, 'R');
+    send_ts(0, &a, v256.data(), v256.size(), false, 32, 5000, now_us);
+    a.doCommands();
+    assert(transfer(a, b, false) != 0); // BeginOfPacket and the first PieceOfPacket
+    assert(transfer(a, b, true) != 0); // the second PieceOfPacket is lost
+    assert(transfer(a, b, false) != 0); // the third PieceOfPacket
+    assert(transfer(b, a, false) != 0); // RepeatInfo of the gap
+    assert(a.txStreams.map[32].fifo.front().repeats.size() == 1);
+    assert(result == 0);
+    assert(transfer(a, b, false) != 0); // only the second PieceOfPacket
+    assert(result == 's');
+    assert(transfer(b, a, false) != 0); // ack
+    assert(a.txStreams.map[32].fifo.empty());
+
+    // the first datagram is reordered, the pieces after it are received into the copy
+
+    now_us += 1 * 1000000;
+    result = 0;
+    setTxStreamPriority_ts(&a, 34, 'R');
+    send_ts(0, &a, v256.data(), v256.size(), false, 34, 5000, now_us);
+    a.doCommands();
+    const uint32_t delayed_B = transfer(a, b, true); // BeginOfPacket and the first piece
+    const std::vector<uint8_t> delayed(a.txBuffer.begin(), a.txBuffer.begin() + delayed_B);
+    assert(transfer(a, b, false) != 0);
+    assert(transfer(a, b, false) != 0);
+    assert(result == 0 and b.rxStreams.map[34].fifo.front().ranges.size() == 1);
+    for (uint32_t i = 0; i < delayed_B; i += readed_B) {
+        readed_B = b.readChunk(now_us, &delayed[i], delayed_B - i);
+        assert(readed_B != 0);
+    }
+    assert(result == 's');
+    assert(transfer(b, a, false) != 0); // ack without RepeatInfo
+    assert(a.txStreams.map[34].fifo.empty() and a.txStreams.map[34].retransmits.empty());
+
+    // CRC32C, a piece corrupted on the way
+
+    assert(crc32c(0, "123456789", 9) == 0xE3069283);
+    assert(crc32c(crc32c(0, "1234", 4), "56789", 5) == 0xE3069283);
+    now_us += 1 * 1000000;
+    result = 0;
+    b.onReceived = [&](uintptr_t context, Connection* connection, const void* data,
+            uint64_t size_B, uint64_t offset_B, uint8_t rxStreamId, char status) {
+        assert(status == 'b' and data == nullptr and size_B == v256.size());
+        result = 'b';
+        return uintptr_t(0);
+    };
+    send_ts(0, &a, v256.data(), v256.size(), false, 34, 5000, now_us);
+    a.doCommands();
+    assert(transfer(a, b, false) != 0);
+    const uint32_t corrupted_B = transfer(a, b, true);
+    a.txBuffer[corrupted_B - 1] ^= 1; // the last byte of the second piece
+    for (uint32_t i = 0; i < corrupted_B; i += readed_B) {
+        readed_B = b.readChunk(now_us, &a.txBuffer[i], corrupted_B - i);
+        assert(readed_B != 0);
+    }
+    assert(transfer(a, b, false) != 0);
+    assert(result == 'b');
+    assert(transfer(b, a, false) != 0); // ack, the sender isn't blocked
+    assert(a.txStreams.map[34].fifo.empty());
+
+    // FEC, a lost packet of an unreliable stream is rebuilt from the parity
+
+    now_us += 1 * 1000000;
+    std::string received;
+    b.onReceived = [&](uintptr_t context, Connection* connection, const void* data,
+            uint64_t size_B, uint64_t offset_B, uint8_t rxStreamId, char status) {
+        assert(status == 's');
+        received.append(static_cast<const char*>(data), size_B);
+        return uintptr_t(0);
+    };
+    a.txPacketsLoss_prc = 10.0f; // groups of 2 packets
+    setTxStreamPriority_ts(&a, 36, 'r');
+    setTxStreamFecState_ts(&a, 36, true);
+    send_ts(0, &a, "ab", 2, true, 36, 5000, now_us);
+    send_ts(0, &a, "cd", 2, true, 36, 5000, now_us);
+    a.doCommands();
+    assert(transfer(a, b, false) != 0); // the first group
+    assert(transfer(a, b, false) != 0); // its parity, then the receiver accumulates
+    assert(received == "abcd" and b.rxStreams.map[36].isFec);
+    assert(a.txStreams.map[36].fifo.empty());
+    send_ts(0, &a, "12345", 5, true, 36, 5000, now_us);
+    send_ts(0, &a, "678", 3, true, 36, 5000, now_us);
+    a.doCommands();
+    a.nextDatagram();
+    std::vector<uint32_t> chunks;
+    offset_B = 0;
+    while ((written_B = a.writeChunk(now_us, &a.txBuffer[offset_B],
+            uint32_t(a.txBuffer.size() - offset_B))) != 0) {
+        chunks.push_back(uint32_t(offset_B));
+        offset_B += written_B;
+    }
+    assert(chunks.size() == 2); // "12345" and "678"
+    for (size_t i = chunks[1]; i < offset_B; i += readed_B) { // "12345" is lost
+        readed_B = b.readChunk(now_us, &a.txBuffer[i], uint32_t(offset_B - i));
+        assert(readed_B != 0);
+    }
+    assert(received == "abcd"); // "678" waits
+    assert(transfer(a, b, false) != 0); // the parity in the next datagram
+    assert(received == "abcd12345678");
+    assert(a.txStreams.map[36].fifo.empty());
+    a.txPacketsLoss_prc = 0;
+
+    // onSend, the pieces are pulled into the datagrams, the lost one again
+
+    now_us += 1 * 1000000;
+    result = 0;
+    uint64_t pulled_B = 0;
+    a.onSend = [&](uintptr_t context, Connection* connection, uint64_t readOffset_B,
+            uint32_t pieceSize_B, uint8_t* writeBuffer, uint8_t txStreamId) {
+        assert(txStreamId == 38 and readOffset_B + pieceSize_B <= v256.size());
+        for (uint32_t i = 0; i < pieceSize_B; ++i) {
+            writeBuffer[i] = uint8_t(readOffset_B + i);
+        }
+        pulled_B += pieceSize_B;
+    };
+    b.onReceived = [&](uintptr_t context, Connection* connection, const void* data,
+            uint64_t size_B, uint64_t offset_B, uint8_t rxStreamId, char status) {
+        assert(status == 's' and size_B == v256.size());
+        assert(std::equal(v256.begin(), v256.end(), static_cast<const uint8_t*>(data)));
+        result = 's';
+        return uintptr_t(0);
+    };
+    setTxStreamPriority_ts(&a, 38, 'R');
+    send_ts(0, &a, nullptr, v256.size(), false, 38, 5000, now_us);
+    a.doCommands();
+    assert(a.txStreams.map[38].fifo.front().isPulled);
+    assert(transfer(a, b, false) != 0);
+    assert(transfer(a, b, true) != 0); // the second piece is lost
+    assert(transfer(a, b, false) != 0);
+    assert(transfer(b, a, false) != 0); // RepeatInfo of the gap
+    assert(transfer(a, b, false) != 0);
+    assert(result == 's' and v256.size() < pulled_B);
+    assert(transfer(b, a, false) != 0); // ack
+    assert(a.txStreams.map[38].fifo.empty());
+    a.onSend = nullptr;
+
+    // the moved vector and the buffer are sent without a copy, released after the ack
+
+    now_us += 1 * 1000000;
+    std::vector<uint8_t> moved(v256);
+    const uint8_t* movedData = moved.data();
+    uint32_t released = 0;
+    Buffer owned(new uint8_t[v256.size()], [&](uint8_t* data) {
+        ++released;
+        delete[] data;
+    });
+    std::copy(v256.begin(), v256.end(), owned.get());
+    const uint8_t* ownedData = owned.get();
+    setTxStreamPriority_ts(&a, 40, 'R');
+    assert(not send_ts(0, &a, std::move(owned), v256.size(), 40, 5, now_us));
+    assert(owned.get() == ownedData); // left to the caller
+    assert(send_ts(0, &a, std::move(moved), 40, 5000, now_us) and moved.empty());
+    assert(send_ts(0, &a, std::move(owned), v256.size(), 40, 5000, now_us));
+    a.doCommands();
+    assert(a.txStreams.map[40].fifo[0].pointer == movedData);
+    assert(a.txStreams.map[40].fifo[1].pointer == ownedData);
+    count = 0;
+    b.onReceived = [&](uintptr_t context, Connection* connection, const void* data,
+            uint64_t size_B, uint64_t offset_B, uint8_t rxStreamId, char status) {
+        assert(status == 's' and size_B == v256.size());
+        assert(std::equal(v256.begin(), v256.end(), static_cast<const uint8_t*>(data)));
+        ++count;
+        return uintptr_t(0);
+    };
+    while (count < 2) {
+        assert(transfer(a, b, false) != 0);
+    }
+    assert(released == 0);
+    assert(transfer(b, a, false) != 0); // ack
+    assert(a.txStreams.map[40].fifo.empty() and released == 1);
+
+    // segments, a header and a payload in pieces are gathered into the datagrams
+
+    now_us += 1 * 1000000;
+    const char header[] = "hdr";
+    const std::vector<Segment> segments = {
+        { header, 3 }, { nullptr, 0 }, { v256.data(), v256.size() }
+    };
+    std::vector<uint8_t> gathered(header, header + 3);
+    gathered.insert(gathered.end(), v256.begin(), v256.end());
+    count = 0;
+    b.onReceived = [&](uintptr_t context, Connection* connection, const void* data,
+            uint64_t size_B, uint64_t offset_B, uint8_t rxStreamId, char status) {
+        assert(status == 's' and size_B == gathered.size());
+        assert(std::equal(gathered.begin(), gathered.end(), static_cast<const uint8_t*>(data)));
+        ++count;
+        return uintptr_t(0);
+    };
+    setTxStreamPriority_ts(&a, 42, 'R');
+    assert(send_ts(0, &a, segments, false, 42, 5000, now_us));
+    assert(send_ts(0, &a, segments, true, 42, 5000, now_us));
+    a.doCommands();
+    assert(a.txStreams.map[42].fifo[0].segments.size() == 3);
+    assert(a.txStreams.map[42].fifo[1].copy == gathered);
+    while (count < 2) {
+        assert(transfer(a, b, false) != 0);
+    }
+    assert(transfer(b, a, false) != 0); // ack
+    assert(a.txStreams.map[42].fifo.empty());
+    b.onReceived = nullptr;
+    a.onDisconnected();
+    b.onDisconnected();
+
     //TODO:
     // 1. txBuffer 100 B, packet 110 B, writted BeginOfPacket and PieceOfPacket
     // 2. txBuffer 128 B, same packet, writted SmallPacket
@@ -1,6 +1,8 @@
 #include "UdpSocket.hpp"
+#include "IoUring.hpp"
 
 #include <cassert>
+#include <algorithm>
 #include <array>
 
 #ifdef _WIN32
@@ -20,6 +22,13 @@
 #   include <arpa/inet.h>
 #   include <pthread.h>
 #endif
+#if defined(__linux__)
+#   include <netinet/udp.h>
+#   include <sys/eventfd.h>
+#   include <linux/filter.h>
+#   include <linux/net_tstamp.h>
+#   include <time.h>
+#endif
 
 
 #ifdef _WIN32
@@ -37,6 +46,44 @@ SocketInitializer g_socketInitializer;
 } // namespace
 #endif
 
+#if defined(__linux__)
+namespace {
+// A coalesced super-datagram consists of segments of segmentSize_B,
+// only the last one may be shorter.
+uint32_t receiveCoalesced(const std::function<void(void*, uint32_t, uint16_t, uint32_t)>& onReceived,
+        char* data, const uint32_t size_B, const sockaddr_in& from, const msghdr* header) {
+    const uint16_t port = bigEndian(from.sin_port);
+    const uint32_t IPv4 = bigEndian(from.sin_addr.s_addr);
+    uint32_t segmentSize_B = size_B;
+    if (header != nullptr) {
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(header); cmsg != nullptr;
+                cmsg = CMSG_NXTHDR(const_cast<msghdr*>(header), cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO) {
+                int32_t value = 0;
+                std::memcpy(&value, CMSG_DATA(cmsg), sizeof(value));
+                if (value > 0) {
+                    segmentSize_B = uint32_t(value);
+                }
+                break;
+            }
+        }
+    }
+    if (size_B == 0) {
+        onReceived(data, 0, port, IPv4);
+        return 1;
+    }
+    uint32_t datagramsCount = 0;
+    for (uint32_t offset_B = 0; offset_B < size_B;) {
+        const uint32_t segment_B = std::min(segmentSize_B, size_B - offset_B);
+        onReceived(data + offset_B, segment_B, port, IPv4);
+        offset_B += segment_B;
+        ++datagramsCount;
+    }
+    return datagramsCount;
+}
+} // namespace
+#endif
+
 
 IPAddress::IPAddress() {}
 IPAddress::IPAddress(const uint32_t IPv4) {
@@ -149,10 +196,29 @@ bool IPAddress::operator==(const IPAddress& other) const {
 
 
 UDPSocket::UDPSocket() {
+    m_isWakeupPending = false;
+# if defined(__linux__)
+    m_wakeupFds[0] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_wakeupFds[1] = m_wakeupFds[0];
+# elif not defined(_WIN32)
+    if (::pipe(m_wakeupFds) == 0) {
+        ::fcntl(m_wakeupFds[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(m_wakeupFds[1], F_SETFL, O_NONBLOCK);
+    }
+# endif
     open();
 }
 UDPSocket::~UDPSocket() {
     close();
+    m_uring.reset();
+# if not defined(_WIN32)
+    if (m_wakeupFds[0] >= 0) {
+        ::close(m_wakeupFds[0]);
+    }
+    if (m_wakeupFds[1] >= 0 and m_wakeupFds[1] != m_wakeupFds[0]) {
+        ::close(m_wakeupFds[1]);
+    }
+# endif
 }
 
 bool UDPSocket::bind(const uint16_t port, const IPAddress multicast, const IPAddress interface) {
@@ -307,6 +373,281 @@ bool UDPSocket::send(const void* data, const uint32_t size_B, const uint16_t por
     return true;
 }
 
+bool UDPSocket::enqueue(const void* data, const uint32_t size_B, const uint16_t port,
+        const uint32_t IPv4, const int64_t departure_us) {
+    if (m_socket == 0) {
+        return false;
+    }
+    if (size_B > 65507) { // 65527 NGTCP2_DEFAULT_MAX_RECV_UDP_PAYLOAD_SIZE
+        return false;
+    }
+    constexpr size_t txBatchSize = 64;
+    constexpr size_t txQueueSize_B = 1 << 18;
+    if (m_txQueue.size() >= txBatchSize or m_txBuffer.size() + size_B > txQueueSize_B) {
+        flush();
+    }
+    TxEntry entry;
+    entry.offset_B = uint32_t(m_txBuffer.size());
+    entry.size_B = size_B;
+    entry.IPv4 = IPv4;
+    entry.port = port;
+    entry.departure_us = m_isTxTimePacingEnabled ? departure_us : 0;
+    auto bytes = static_cast<const char*>(data);
+    m_txBuffer.insert(m_txBuffer.end(), bytes, bytes + size_B);
+    m_txQueue.push_back(entry);
+    return true;
+}
+void UDPSocket::flush() {
+    if (m_txQueue.empty()) {
+        return;
+    }
+# if defined(__linux__)
+    constexpr size_t txBatchSize = 64;
+    constexpr size_t maxSegments = 64; // UDP_MAX_SEGMENTS of older kernels
+    constexpr size_t maxSegmentsSize_B = 65507;
+    // EINVAL is also e.g. for a segment above the path MTU, so GSO is disabled
+    // only if it fails persistently
+    constexpr uint32_t maxSegmentationFailures = 16;
+    std::array<mmsghdr, txBatchSize> messages;
+    std::array<iovec, txBatchSize> datagrams;
+    std::array<sockaddr_in, txBatchSize> tos;
+    union Control {
+        char buffer[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(uint64_t))];
+        cmsghdr align;
+    };
+    std::array<Control, txBatchSize> controls;
+    std::array<std::pair<size_t, size_t>, txBatchSize> entries; // first, count
+
+    for (size_t idx = 0; idx < m_txQueue.size();) {
+        size_t count = 0;
+        for (; count < txBatchSize and idx < m_txQueue.size(); ++count) {
+            const TxEntry& first = m_txQueue[idx];
+            // Consecutive datagrams to the same peer are already contiguous in m_txBuffer,
+            // so they are sent as one super-datagram, which the kernel splits by segmentSize_B.
+            // Only the last segment may be shorter.
+            size_t segments = 1;
+            size_t size_B = first.size_B;
+            if (m_isTxSegmentationEnabled) {
+                while (idx + segments < m_txQueue.size() and segments < maxSegments) {
+                    const TxEntry& prev = m_txQueue[idx + segments - 1];
+                    const TxEntry& next = m_txQueue[idx + segments];
+                    if (next.IPv4 != first.IPv4 or next.port != first.port
+                            or next.departure_us != first.departure_us
+                            or prev.size_B != first.size_B or next.size_B > first.size_B
+                            or size_B + next.size_B > maxSegmentsSize_B) {
+                        break;
+                    }
+                    size_B += next.size_B;
+                    ++segments;
+                }
+            }
+            datagrams[count].iov_base = &m_txBuffer[first.offset_B];
+            datagrams[count].iov_len = size_B;
+            tos[count] = {};
+            tos[count].sin_addr.s_addr = bigEndian(first.IPv4);
+            tos[count].sin_family = AF_INET;
+            tos[count].sin_port = bigEndian(first.port);
+            messages[count] = {};
+            messages[count].msg_hdr.msg_name = &tos[count];
+            messages[count].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            messages[count].msg_hdr.msg_iov = &datagrams[count];
+            messages[count].msg_hdr.msg_iovlen = 1;
+            size_t controlSize_B = 0;
+            if (segments > 1) {
+                auto cmsg = reinterpret_cast<cmsghdr*>(&controls[count].buffer[controlSize_B]);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                const uint16_t segmentSize_B = uint16_t(first.size_B);
+                std::memcpy(CMSG_DATA(cmsg), &segmentSize_B, sizeof(segmentSize_B));
+                controlSize_B += CMSG_SPACE(sizeof(uint16_t));
+            }
+            if (first.departure_us > 0) {
+                auto cmsg = reinterpret_cast<cmsghdr*>(&controls[count].buffer[controlSize_B]);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_TXTIME;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                const uint64_t departure_ns = uint64_t(first.departure_us) * 1000;
+                std::memcpy(CMSG_DATA(cmsg), &departure_ns, sizeof(departure_ns));
+                controlSize_B += CMSG_SPACE(sizeof(uint64_t));
+            }
+            if (controlSize_B > 0) {
+                messages[count].msg_hdr.msg_control = controls[count].buffer;
+                messages[count].msg_hdr.msg_controllen = controlSize_B;
+            }
+            entries[count] = { idx, segments };
+            idx += segments;
+        }
+        // The batch is sent without GSO
+        const auto sendSeparately = [this, &entries](const size_t message) {
+            if (++m_txSegmentationFailures >= maxSegmentationFailures) {
+                m_isTxSegmentationEnabled = false; // no support by the kernel or the device
+            }
+            for (size_t i = 0; i < entries[message].second; ++i) {
+                const TxEntry& entry = m_txQueue[entries[message].first + i];
+                send(&m_txBuffer[entry.offset_B], entry.size_B, entry.port, entry.IPv4);
+            }
+        };
+        if (m_uring != nullptr) {
+            std::array<msghdr, txBatchSize> headers;
+            std::array<int32_t, txBatchSize> results;
+            for (size_t i = 0; i < count; ++i) {
+                headers[i] = messages[i].msg_hdr;
+            }
+            m_uring->send(int32_t(m_socket), headers.data(), results.data(), uint32_t(count));
+            uint32_t sentDatagrams = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (results[i] >= 0) {
+                    sentDatagrams += uint32_t(entries[i].second);
+                    if (entries[i].second > 1) {
+                        m_txSegmentationFailures = 0;
+                    }
+                }
+                else if (entries[i].second > 1 and (results[i] == -EIO or results[i] == -EINVAL)) {
+                    sendSeparately(i);
+                }
+            }
+            if (sentDatagrams > 0) {
+                m_txBatchStatistics.add(sentDatagrams);
+            }
+            continue;
+        }
+        for (size_t sent = 0; sent < count;) {
+            const int32_t result = ::sendmmsg(
+                m_socket, &messages[sent], uint32_t(count - sent), 0
+            );
+            if (result > 0) {
+                uint32_t sentDatagrams = 0;
+                for (size_t i = sent; i < sent + result; ++i) {
+                    sentDatagrams += uint32_t(entries[i].second);
+                    if (entries[i].second > 1) {
+                        m_txSegmentationFailures = 0;
+                    }
+                }
+                m_txBatchStatistics.add(sentDatagrams);
+                sent += result;
+                continue;
+            }
+            if (entries[sent].second > 1 and (errno == EIO or errno == EINVAL)) {
+                sendSeparately(sent);
+            }
+            ++sent; // dropped, like a failed sendto
+        }
+    }
+# else
+    for (const TxEntry& entry : m_txQueue) {
+        if (send(&m_txBuffer[entry.offset_B], entry.size_B, entry.port, entry.IPv4)) {
+            m_txBatchStatistics.add(1);
+        }
+    }
+# endif
+    m_txQueue.clear();
+    m_txBuffer.clear();
+}
+
+bool UDPSocket::setTxSegmentationOffload(const bool isEnabled) {
+# if defined(__linux__) && defined(UDP_SEGMENT)
+    if (isEnabled) {
+        // Zero segment size is a no-op, only to check the kernel support
+        const int32_t value = 0;
+        if (::setsockopt(m_socket, SOL_UDP, UDP_SEGMENT,
+                reinterpret_cast<const char*>(&value), sizeof(value)) == -1) {
+            m_isTxSegmentationEnabled = false;
+            return false;
+        }
+    }
+    m_isTxSegmentationEnabled = isEnabled;
+    m_txSegmentationFailures = 0;
+    return true;
+# else
+    m_isTxSegmentationEnabled = false;
+    return not isEnabled;
+# endif
+}
+bool UDPSocket::getTxSegmentationOffload() const {
+    return m_isTxSegmentationEnabled;
+}
+bool UDPSocket::setRxCoalescingOffload(const bool isEnabled) {
+# if defined(__linux__) && defined(UDP_GRO)
+    const int32_t value = isEnabled ? 1 : 0;
+    if (::setsockopt(m_socket, SOL_UDP, UDP_GRO,
+            reinterpret_cast<const char*>(&value), sizeof(value)) == -1) {
+        m_isRxCoalescingEnabled = false;
+        return false;
+    }
+    m_isRxCoalescingEnabled = isEnabled;
+    return true;
+# else
+    m_isRxCoalescingEnabled = false;
+    return not isEnabled;
+# endif
+}
+bool UDPSocket::getRxCoalescingOffload() const {
+    return m_isRxCoalescingEnabled;
+}
+bool UDPSocket::setTxTimePacing(const bool isEnabled) {
+# if defined(__linux__) && defined(SO_TXTIME)
+    // std::chrono::steady_clock is CLOCK_MONOTONIC
+    sock_txtime config = {};
+    config.clockid = CLOCK_MONOTONIC;
+    config.flags = 0;
+    if (isEnabled and ::setsockopt(m_socket, SOL_SOCKET, SO_TXTIME,
+            reinterpret_cast<const char*>(&config), sizeof(config)) == -1) {
+        m_isTxTimePacingEnabled = false;
+        return false;
+    }
+    m_isTxTimePacingEnabled = isEnabled;
+    return true;
+# else
+    m_isTxTimePacingEnabled = false;
+    return not isEnabled;
+# endif
+}
+bool UDPSocket::getTxTimePacing() const {
+    return m_isTxTimePacingEnabled;
+}
+bool UDPSocket::setMaxPacingRate_B_s(const uint32_t rate_B_s) {
+# if defined(__linux__) && defined(SO_MAX_PACING_RATE)
+    if (::setsockopt(m_socket, SOL_SOCKET, SO_MAX_PACING_RATE,
+            reinterpret_cast<const char*>(&rate_B_s), sizeof(rate_B_s)) == -1) {
+        return false;
+    }
+    return true;
+# else
+    return rate_B_s == UINT32_MAX;
+# endif
+}
+
+bool UDPSocket::setIoUring(const bool isEnabled) {
+# if defined(__linux__)
+    if (not isEnabled) {
+        m_uring.reset();
+        return true;
+    }
+    if (m_uring != nullptr) {
+        return true;
+    }
+    if (m_isIoUringFailed) {
+        return false;
+    }
+    // Room for io_uring_recvmsg_out, the address and the UDP_GRO cmsg before the payload
+    constexpr uint32_t bufferSize_B = UINT16_MAX + 1 + 256;
+    auto uring = std::make_unique<IoUring>();
+    if (not uring->init(256, 64, bufferSize_B)) {
+        m_isIoUringFailed = true;
+        return false;
+    }
+    m_uring = std::move(uring);
+    m_uringGeneration = m_socketGeneration - 1; // armed by process()
+    return true;
+# else
+    return not isEnabled;
+# endif
+}
+bool UDPSocket::getIoUring() const {
+    return m_uring != nullptr;
+}
+
 bool UDPSocket::setIpDontFragment(const bool isEnabled) {
     switch (AF_INET) { //TODO: IPv6
 # if defined(IP_DONTFRAGMENT)
@@ -379,9 +720,33 @@ bool UDPSocket::setReusePort(const bool isEnabled) {
             reinterpret_cast<const char*>(&value), sizeof(value)) == -1) {
         return false;
     }
+    m_isReusePortEnabled = isEnabled;
     return true;
 }
 # endif
+bool UDPSocket::setReusePortSteering(const uint32_t offset_B, const uint32_t socketsCount) {
+# if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    if (socketsCount == 0) {
+        return false;
+    }
+    // The program sees the UDP payload, a short datagram goes to the socket 0
+    sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, offset_B }, // A = payload[offset_B]
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, socketsCount }, // A %= socketsCount
+        { BPF_RET | BPF_A, 0, 0, 0 }, // return A
+    };
+    sock_fprog program = {};
+    program.len = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+    if (::setsockopt(m_socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+            reinterpret_cast<const char*>(&program), sizeof(program)) == -1) {
+        return false;
+    }
+    return true;
+# else
+    return false;
+# endif
+}
 bool UDPSocket::setReuseAddress(const bool isEnabled) {
     const int32_t value = isEnabled ? 1 : 0;
     if (::setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR,
@@ -426,6 +791,34 @@ uint32_t UDPSocket::getTxBufferSize_B() const {
 }
 
 void UDPSocket::process(const uint32_t timeout_ms) {
+# if defined(__linux__)
+    if (m_uring != nullptr) {
+        if (m_uringGeneration != m_socketGeneration) {
+            m_uring->armReceive(int32_t(m_socket), CMSG_SPACE(sizeof(int32_t)));
+            m_uring->armWakeup(m_wakeupFds[0]);
+            m_uringGeneration = m_socketGeneration;
+        }
+        uint32_t datagramsCount = 0;
+        const bool isWokenUp = m_uring->process(timeout_ms, [this, &datagramsCount](char* data, uint32_t size_B,
+                const sockaddr_in& from, const msghdr& header) {
+            if (onReceived != nullptr) {
+                datagramsCount += receiveCoalesced(onReceived, data, size_B, from,
+                    m_isRxCoalescingEnabled ? &header : nullptr);
+            }
+        });
+        if (datagramsCount > 0) {
+            m_rxBatchStatistics.add(datagramsCount);
+        }
+        if (isWokenUp or m_isWakeupPending) {
+            drainWakeup();
+        }
+        if (m_uring->isFailed()) {
+            m_uring.reset();
+            m_isIoUringFailed = true;
+        }
+        return;
+    }
+# endif
     if (timeout_ms > 0) {
 #     ifdef _WIN32
         WSAPOLLFD fd = {};
@@ -435,31 +828,113 @@ void UDPSocket::process(const uint32_t timeout_ms) {
             return;
         }
 #     else
-        struct pollfd fd = {};
-        fd.fd = m_socket;
-        fd.events = POLLIN;
-        if (::poll(&fd, 1, timeout_ms) <= 0) {
+        struct pollfd fds[2] = {};
+        fds[0].fd = int32_t(m_socket);
+        fds[0].events = POLLIN;
+        fds[1].fd = m_wakeupFds[0];
+        fds[1].events = POLLIN;
+        const int32_t result = ::poll(fds, m_wakeupFds[0] >= 0 ? 2 : 1, timeout_ms);
+        if ((fds[1].revents & POLLIN) or m_isWakeupPending) {
+            drainWakeup();
+        }
+        if (result <= 0 or not (fds[0].revents & POLLIN)) {
             return;
         }
 #     endif
     }
-    thread_local std::array<char, UINT16_MAX> buffer;
-    sockaddr_in from = {};
-    socklen_t fromLen_B = sizeof(from);
-
     if (onReceived == nullptr) {
         return;
     }
+# if defined(__linux__)
+    // One recvmmsg per up to rxBatchSize datagrams instead of one recvfrom per datagram
+    constexpr uint32_t rxBatchSize = 32;
+    constexpr uint32_t slotSize_B = UINT16_MAX;
+    if (m_rxBuffer.size() < rxBatchSize * slotSize_B) {
+        m_rxBuffer.resize(rxBatchSize * slotSize_B);
+    }
+    std::array<mmsghdr, rxBatchSize> messages;
+    std::array<iovec, rxBatchSize> slots;
+    std::array<sockaddr_in, rxBatchSize> froms;
+    union Control {
+        char buffer[CMSG_SPACE(sizeof(int32_t))];
+        cmsghdr align;
+    };
+    std::array<Control, rxBatchSize> controls;
+
+    while (true) {
+        for (uint32_t i = 0; i < rxBatchSize; ++i) {
+            slots[i].iov_base = &m_rxBuffer[i * slotSize_B];
+            slots[i].iov_len = slotSize_B;
+            messages[i] = {};
+            messages[i].msg_hdr.msg_name = &froms[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            messages[i].msg_hdr.msg_iov = &slots[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            if (m_isRxCoalescingEnabled) {
+                messages[i].msg_hdr.msg_control = controls[i].buffer;
+                messages[i].msg_hdr.msg_controllen = sizeof(controls[i].buffer);
+            }
+        }
+        const int32_t count = ::recvmmsg(
+            m_socket, messages.data(), rxBatchSize, MSG_DONTWAIT, nullptr
+        );
+        if (count <= 0) {
+            break;
+        }
+        uint32_t datagramsCount = 0;
+        for (int32_t i = 0; i < count; ++i) {
+            datagramsCount += receiveCoalesced(onReceived, static_cast<char*>(slots[i].iov_base),
+                messages[i].msg_len, froms[i],
+                m_isRxCoalescingEnabled ? &messages[i].msg_hdr : nullptr);
+        }
+        m_rxBatchStatistics.add(datagramsCount);
+        if (uint32_t(count) < rxBatchSize) {
+            break; // drained
+        }
+    }
+# else
+    if (m_rxBuffer.size() < UINT16_MAX) {
+        m_rxBuffer.resize(UINT16_MAX);
+    }
+    sockaddr_in from = {};
+    socklen_t fromLen_B = sizeof(from);
+
     while (true) {
         const int32_t received_B = ::recvfrom(
-            m_socket, buffer.data(), int32_t(buffer.size()), 0,
+            m_socket, m_rxBuffer.data(), int32_t(m_rxBuffer.size()), 0,
             reinterpret_cast<sockaddr*>(&from), &fromLen_B
         );
         if (received_B < 0) {
             break;
         }
-        onReceived(buffer.data(), received_B, bigEndian(from.sin_port), bigEndian(from.sin_addr.s_addr));
+        m_rxBatchStatistics.add(1);
+        onReceived(m_rxBuffer.data(), received_B, bigEndian(from.sin_port), bigEndian(from.sin_addr.s_addr));
+    }
+# endif
+}
+void UDPSocket::wakeup() {
+# if not defined(_WIN32)
+    if (m_wakeupFds[1] < 0 or m_isWakeupPending.exchange(true)) {
+        return;
     }
+    const uint64_t value = 1; // eventfd counter, any byte for a pipe
+    void(::write(m_wakeupFds[1], &value, sizeof(value)));
+# endif
+}
+void UDPSocket::drainWakeup() {
+# if not defined(_WIN32)
+    // Drains before clearing, so a write racing with it leaves only a spurious wakeup
+    uint64_t value = 0;
+    while (::read(m_wakeupFds[0], &value, sizeof(value)) > 0) {
+    }
+# endif
+    m_isWakeupPending = false;
+}
+const UDPSocket::BatchStatistics& UDPSocket::getRxBatchStatistics() const {
+    return m_rxBatchStatistics;
+}
+const UDPSocket::BatchStatistics& UDPSocket::getTxBatchStatistics() const {
+    return m_txBatchStatistics;
 }
 
 bool UDPSocket::setThreadPriority(const uintptr_t thread, const char priority) {
@@ -492,6 +967,7 @@ bool UDPSocket::setThreadPriority(const uintptr_t thread, const char priority) {
 void UDPSocket::open() {
     close();
     m_socket = ::socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ++m_socketGeneration;
 
 # ifdef _WIN32
     u_long nonBlocking = 1;
@@ -509,6 +985,9 @@ void UDPSocket::open() {
             reinterpret_cast<char*>(&yes), sizeof(yes)) == -1) {
         //err() << "Failed to enable broadcast on UDP socket" << std::endl;
     }
+    if (m_isReusePortEnabled) {
+        setReusePort(true);
+    }
 }
 void UDPSocket::close() {
     if (m_socket == 0) {
@@ -523,4 +1002,3 @@ void UDPSocket::close() {
 }
 
 //TODO: https://learn.microsoft.com/en-us/windows-hardware/drivers/netcx/gso-offload
-//TODO: UDP_SEGMENT, SO_MAX_PACING_RATE, SO_TXTIME, SCM_TXTIME
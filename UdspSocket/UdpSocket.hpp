@@ -3,7 +3,12 @@
 #include <string>
 #include <cstring>
 #include <functional>
+#include <vector>
 #include <array>
+#include <memory>
+#include <atomic>
+
+class IoUring;
 
 
 class IPAddress {
@@ -68,21 +73,74 @@ public:
 
     bool send(const void* data, const uint32_t size_B, const uint16_t port,
         const uint32_t IPv4 = UINT32_MAX);
+    // Copies the datagram into the transmit queue, which is flushed when it is full.
+    // departure_us:
+    //   0 - as soon as possible
+    //  >0 - steady clock time to leave the host, if the TX time pacing is enabled
+    bool enqueue(const void* data, const uint32_t size_B, const uint16_t port,
+        const uint32_t IPv4 = UINT32_MAX, const int64_t departure_us = 0);
+    // Sends all queued datagrams, by sendmmsg on Linux.
+    void flush();
     std::function<void(void* data, uint32_t size_B, uint16_t port, uint32_t IPv4)>
         onReceived;
 
     bool setIpDontFragment(const bool isEnabled);
+    // Kept for the sockets re-created by bind()
     bool setReusePort(const bool isEnabled);
+    // Linux only. Datagrams to the SO_REUSEPORT group are steered by 32 bits of the
+    // payload at offset_B modulo socketsCount (SO_ATTACH_REUSEPORT_CBPF) instead of
+    // the 4-tuple hash. The index is the order of bind(), applies to the whole group.
+    bool setReusePortSteering(const uint32_t offset_B, const uint32_t socketsCount);
     bool setReuseAddress(const bool isEnabled);
     bool setRxBufferSize_B(const uint32_t size_B);
     uint32_t getRxBufferSize_B() const;
     bool setTxBufferSize_B(const uint32_t size_B);
     uint32_t getTxBufferSize_B() const;
+    // UDP GSO (UDP_SEGMENT): datagrams to the same peer in the transmit queue are
+    // flushed as one super-datagram. Falls back to plain sends if unsupported.
+    bool setTxSegmentationOffload(const bool isEnabled);
+    bool getTxSegmentationOffload() const;
+    // UDP GRO (UDP_GRO): the kernel may coalesce received datagrams of the same flow,
+    // process() splits them back before calling onReceived.
+    bool setRxCoalescingOffload(const bool isEnabled);
+    bool getRxCoalescingOffload() const;
+    // SO_TXTIME: queued datagrams with departure_us are stamped with SCM_TXTIME,
+    // so the fq qdisc spaces them. Without fq the stamps are ignored.
+    bool setTxTimePacing(const bool isEnabled);
+    bool getTxTimePacing() const;
+    // SO_MAX_PACING_RATE, UINT32_MAX - unlimited. Enforced by the fq qdisc.
+    bool setMaxPacingRate_B_s(const uint32_t rate_B_s);
+    // Linux 6.0+. Receives by a multishot recvmsg into a provided buffer ring and
+    // submits flushed batches as one io_uring_enter instead of poll+recvmmsg+sendmmsg.
+    // Falls back to them if the kernel rejects the ring or the multishot receive.
+    // Must be called from the thread that calls process().
+    bool setIoUring(const bool isEnabled);
+    bool getIoUring() const;
 
     // timeout_ms:
     // 0 - non-blocking, the delay of input flow depends on polling frequency
     // >0 - blocking, the delay of input flow depends on receive events
     void process(const uint32_t timeout_ms = 1000 / 50);
+    // Thread-safe. Interrupts the waiting of process() by an eventfd (a pipe on other
+    // POSIX systems), at most one write per wait. No-op on Windows.
+    void wakeup();
+
+    // Cumulative since the socket was created
+    struct BatchStatistics {
+        uint64_t callsCount = 0; // syscalls that returned datagrams
+        uint64_t datagramsCount = 0;
+        uint32_t maxBatchSize = 0;
+
+        void add(const uint32_t batchSize) {
+            ++callsCount;
+            datagramsCount += batchSize;
+            if (maxBatchSize < batchSize) {
+                maxBatchSize = batchSize;
+            }
+        }
+    };
+    const BatchStatistics& getRxBatchStatistics() const;
+    const BatchStatistics& getTxBatchStatistics() const;
 
     // 'H'ighest, 'h'igh, 'n'ormal, 'l'ow, 'L'owest
     static bool setThreadPriority(const uintptr_t thread, const char priority = 'n');
@@ -91,6 +149,34 @@ private:
     void open();
     void close();
     uintptr_t m_socket = 0;
+    uint32_t m_socketGeneration = 0; // the same descriptor could be reused by open()
+
+    std::vector<char> m_rxBuffer; // rxBatchSize slots by UINT16_MAX, allocated on demand
+    BatchStatistics m_rxBatchStatistics;
+
+    struct TxEntry {
+        uint32_t offset_B = 0; // in m_txBuffer
+        uint32_t size_B = 0;
+        uint32_t IPv4 = 0;
+        uint16_t port = 0;
+        int64_t departure_us = 0;
+    };
+    std::vector<char> m_txBuffer;
+    std::vector<TxEntry> m_txQueue;
+    BatchStatistics m_txBatchStatistics;
+    bool m_isTxSegmentationEnabled = false;
+    uint32_t m_txSegmentationFailures = 0; // consecutive
+    bool m_isRxCoalescingEnabled = false;
+    bool m_isTxTimePacingEnabled = false;
+    bool m_isReusePortEnabled = false;
+
+    void drainWakeup();
+    int32_t m_wakeupFds[2] = { -1, -1 }; // read, write
+    std::atomic<bool> m_isWakeupPending;
+
+    std::unique_ptr<IoUring> m_uring;
+    uint32_t m_uringGeneration = 0; // of the socket with the armed receive
+    bool m_isIoUringFailed = false;
 };
 
 
@@ -29,7 +29,11 @@ public:
     bool isConnected() const;
 
     // server
-    bool listen(const uint16_t port);
+    // threadsCount > 1 - the connections are spread by the kernel (SO_REUSEPORT) over
+    // workers, each with its own socket and thread. Linux and BSD only. On Linux by
+    // connectionId (SO_ATTACH_REUSEPORT_CBPF), otherwise by the peer address.
+    // The callbacks are called from the worker threads concurrently.
+    bool listen(const uint16_t port, const uint32_t threadsCount = 1);
 
     struct Connection;
     void setOnConnected(std::function<void(Connection*)>&& onConnected);
@@ -55,22 +59,59 @@ public:
     //  'L' - reliable low
     //  'l' - unreliable low
     //   0  - undefined
-    //NOTE: Calling it in the onDisconnected callback causes a deadlock!
+    // Realtime streams are sent first (up to 98 % while the others are waiting),
+    // the others share the rest by deficit round-robin with weights 20/4/1 (80/16/4 %).
+    // The setters of a stream take the mutex of the I/O thread, so they are never dropped
+    // by a full send queue.
+    //NOTE: Calling them in the onDisconnected callback causes a deadlock!
     void setTxStreamPriority(Connection* connection, uint8_t txStreamId, char priority = 'M');
+    // The share of a non-realtime stream, 0 - by its priority.
+    // E.g. weights 3 and 1 of two busy streams give them 75 % and 25 %.
+    void setTxStreamWeight(Connection* connection, uint8_t txStreamId, uint32_t weight = 0);
+    // FEC of an unreliable stream ('r', 'h', 'm', 'l'), by default - disabled.
+    // A XOR parity of each group of small packets (up to 1 KiB), sent in a later datagram,
+    // lets the receiver rebuild one lost packet of the group without a repeat.
+    // A group is 16...2 packets by the TX loss (no parity below 0.5 %) or max(RTT / 2, 2 ms) long.
+    // The received packets after a lost one wait for the parity of its group.
+    void setTxStreamFecState(Connection* connection, uint8_t txStreamId, bool isEnabled);
+    // Bytes per unit of weight in each round, 256 by default.
+    // Bigger - fewer switches between streams, smaller - finer interleaving.
+    void setTxQuantum_B(Connection* connection, uint32_t quantum_B = 256);
+    uint32_t getTxQuantum_B(Connection* connection) const;
     //char getTxStreamPriority(Connection* connection, uint8_t txStreamId) const;
 
     // copy:
     //   true - make an internal copy of the data
     //   false - work with the data by a pointer
-    //NOTE: Calling it in the onDisconnected callback causes a deadlock!
+    // data == nullptr - the data is pulled piece by piece by onSend, copy is ignored
+    // Wait-free and without an allocation (besides the copy of the data) for up to 256 queued
+    // sends of the connection, the next ones wait for the mutex of the I/O thread.
     bool send(uintptr_t context, Connection* connection, const void* data, uint64_t size_B,
         bool copy, uint8_t txStreamId = 0, uint32_t timeout_ms = 5000);
-    //bool send(uintptr_t context, Connection* connection, std::vector<uint8_t>&& data,
-    //    uint8_t txStreamId = 0, uint32_t timeout_ms = 5000);
-    //void setOnSend(std::function<void(
-    //    uintptr_t context, Connection* connection, uint64_t readOffset_B,
-    //    uint32_t pieceSize_B, uint8_t* writeBuffer, uint8_t txStreamId
-    //)>&& onSend);
+    // Takes the ownership of the data without a copy. If false is returned,
+    // the data is left in the argument.
+    bool send(uintptr_t context, Connection* connection, std::vector<uint8_t>&& data,
+        uint8_t txStreamId = 0, uint32_t timeout_ms = 5000);
+    // Memory released by its deleter after the delivery, e.g. into a pool
+    using Buffer = std::unique_ptr<uint8_t[], std::function<void(uint8_t*)>>;
+    bool send(uintptr_t context, Connection* connection, Buffer&& data, uint64_t size_B,
+        uint8_t txStreamId = 0, uint32_t timeout_ms = 5000);
+    // A packet of several parts, e.g. a header and a payload, gathered into the datagrams.
+    // copy == false - the segments are gathered by the pointers, onDelivered gets data == nullptr
+    struct Segment {
+        const void* data;
+        uint64_t size_B;
+    };
+    bool send(uintptr_t context, Connection* connection,
+        const std::vector<Segment>& segments, bool copy,
+        uint8_t txStreamId = 0, uint32_t timeout_ms = 5000);
+    // Writes pieceSize_B bytes of the packet from readOffset_B directly into the datagram.
+    // A piece may be pulled again to repeat it, the bytes must be the same.
+    // The pulled packets are sent without CRC32C, onDelivered gets data == nullptr.
+    void setOnSend(Connection* connection, std::function<void(
+        uintptr_t context, Connection* connection, uint64_t readOffset_B,
+        uint32_t pieceSize_B, uint8_t* writeBuffer, uint8_t txStreamId
+    )>&& onSend);
 
     // status:
     //  's' - success | sent
@@ -88,7 +129,7 @@ public:
     // status:
     //  's' - success
     //  'p' - piece
-    //  -- 'b' - bad CRC32
+    //  'b' - bad CRC32C of the whole packet, data == nullptr
     //  'l' - lost
     //  't' - timed out
     //  'd' - disconnected
@@ -101,6 +142,14 @@ public:
     //uint32_t getRxSpeedLimit_B_s(Connection* connection) const;
     void setTxSpeedLimit_B_s(Connection* connection, uint32_t limit_B_s);
     uint32_t getTxSpeedLimit_B_s(Connection* connection) const;
+    // Asks the peer to acknowledge the reliable data of this side after every
+    // ackEveryN chunks or within maxAckDelay_us, whichever comes first.
+    // Acks are piggybacked on the other datagrams anyway. By default - immediately.
+    // Fewer acks - less reverse traffic, but later repeats of the lost packets.
+    // The request is repeated every second, so if its datagram is lost,
+    // the peer keeps the previous frequency for up to 1 s.
+    void setAckFrequency(Connection* connection, uint8_t ackEveryN = 1,
+        uint32_t maxAckDelay_us = 0);
 
     uint32_t getRxSpeed_B_s(Connection* connection) const; // 1 Hz
     uint32_t getTxSpeed_B_s(Connection* connection) const; // 1 Hz
@@ -112,7 +161,29 @@ public:
     void setTestBandwidthState(const bool isEnabled = false);
     bool getTestBandwidthState() const;
 
+    // Linux only. Paced datagrams are stamped with departure times (SO_TXTIME)
+    // derived from the TX speed limit, so the fq qdisc spaces them by microseconds
+    // instead of bursting every 10 ms.
+    bool setTxTimePacingState(const bool isEnabled = false);
+    bool getTxTimePacingState() const;
+    // Linux only. The current TX limit of the congestion control (the sum of limits
+    // on the server) is mirrored into SO_MAX_PACING_RATE of the socket.
+    bool setMaxPacingRateState(const bool isEnabled = false);
+    bool getMaxPacingRateState() const;
+    // Linux 6.0+ only. The socket I/O goes through io_uring: a multishot receive
+    // into a provided buffer ring and one submission per flushed batch.
+    // Reverts to false if the kernel doesn't support it.
+    bool setIoUringState(const bool isEnabled = false);
+    bool getIoUringState() const;
+    // Streams of the same priority are served by the earliest timeout of their next
+    // packets instead of the round-robin, and a packet which can't be delivered
+    // in time with the current RTT and TX speed is dropped before sending ('t').
+    void setDeadlineSchedulingState(const bool isEnabled = false);
+    bool getDeadlineSchedulingState() const;
+
 private:
     struct Impl;
     std::unique_ptr<Impl> m_impl;
+    std::vector<std::unique_ptr<Impl>> m_shards; // the other workers of the server
+
 };